@@ -14,6 +14,8 @@
 #include "os-mm.h"
 #endif
 
+#include "rbtree.h"
+
 #define ADDRESS_SIZE 20
 #define OFFSET_LEN 10
 #define FIRST_LV_LEN 5
@@ -44,10 +46,31 @@ struct inst_t
 	uint32_t arg_3;
 };
 
+struct pcb_t;
+struct dinst_t;
+
+/* Executes one decoded instruction for a process */
+typedef int (*inst_handler_t)(struct pcb_t *proc, const struct dinst_t *ins);
+
+/* An instruction decoded at load time: its handler and its operands */
+struct dinst_t
+{
+	inst_handler_t handler;
+	uint32_t arg_0;
+	uint32_t arg_1;
+	uint32_t arg_2;
+	uint32_t arg_3;
+	uint32_t calc_run; // CALC instructions in a row from here, 0 if none
+};
+
 struct code_seg_t
 {
 	struct inst_t *text;
+	struct dinst_t *ops; // text decoded by decode(), what run() executes
 	uint32_t size;
+	void *map;	     // Compiled program the text lives in, if mapped
+	size_t map_size;
+	uint32_t refs;	     // Processes sharing it, see load()
 };
 
 struct trans_table_t
@@ -82,14 +105,17 @@ struct pcb_t
 	struct code_seg_t *code; // Code segment
 	addr_t regs[10];	 // Registers, store address of allocated regions
 	uint32_t pc;		 // Program pointer, point to the next instruction
-	struct queue_t *ready_queue;
-	struct queue_t *running_list;
-#ifdef MLQ_SCHED
-	struct queue_t *mlq_ready_queue;
+	struct pcb_t *run_prev;	 // Running list links, owned by the scheduler
+	struct pcb_t *run_next;
+	uint32_t run_ticks;	 // Instructions run since the last dispatch
+	int last_cpu;		 // CPU it last ran on, -1 before its first run
 	// Priority on execution (if supported), on-fly aka. changeable
 	// and this vale overwrites the default priority when it existed
 	uint32_t prio;
-#endif
+	struct rb_node run_node;	 // Fair policy tree links
+	uint64_t vruntime;		 // Fair policy weighted run time
+	uint64_t deadline;		 // Absolute deadline (time slot), 0 if none
+	uint64_t enqueue_time;	 // Time slot it was last queued at
 #ifdef MM_PAGING
 	struct mm_struct *mm;
 	struct memphy_struct *mram;
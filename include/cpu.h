@@ -9,5 +9,19 @@
  * Otherwise, return 1. */
 int run(struct pcb_t * proc);
 
+/* Decode the text of [code] into code->ops. Each instruction gets its
+ * handler once here, so run() calls it without a switch: one indirect
+ * call per instruction, no dispatch loop to thread with goto */
+void decode(struct code_seg_t * code);
+
+/* Number of CALC instructions in a row from the pc of [proc]. Only
+ * batch mode collapses a run, in lockstep every CALC owns a slot of
+ * the clock and goes through run() on its own */
+uint32_t calc_run(struct pcb_t * proc);
+
+/* Execute the next [n] instructions of [proc], all CALC, with a single
+ * dispatch. n is at most calc_run(proc) */
+void run_calc(struct pcb_t * proc, uint32_t n);
+
 #endif
 
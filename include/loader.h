@@ -3,7 +3,14 @@
 
 #include "common.h"
 
+/* Create a process running the program at [path], in text or compiled
+ * form. Its PID is left to the caller. Return NULL if the program
+ * cannot be loaded */
 struct pcb_t * load(const char * path);
 
+/* Free a process that exited. Its code goes with the last process
+ * running the same program */
+void unload(struct pcb_t * proc);
+
 #endif
 
@@ -1,7 +1,8 @@
 #ifndef OSCFG_H
 #define OSCFG_H
 
-#define MLQ_SCHED 1
+/* Scheduling policy used when the config file does not name one */
+#define SCHED_DEFAULT_POLICY "mlq"
 #define MAX_PRIO 140
 
 #define MM_PAGING
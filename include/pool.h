@@ -0,0 +1,20 @@
+#ifndef POOL_H
+#define POOL_H
+
+/* Fixed pool of host threads running batches of small independent
+ * tasks. Every worker starts with a slice of the batch and steals from
+ * the others once its own slice is empty. */
+struct pool;
+
+/* Start a pool of [nr_workers] workers. The thread calling pool_run()
+ * is one of them, so nr_workers - 1 threads are created */
+struct pool * pool_create(int nr_workers);
+
+/* Call fn(arg, i) for every i in [0, n) on the workers and return once
+ * all calls returned */
+void pool_run(struct pool * pool, int n, void (*fn)(void *, int), void * arg);
+
+void pool_destroy(struct pool * pool);
+
+#endif
+
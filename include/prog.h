@@ -0,0 +1,35 @@
+#ifndef PROG_H
+#define PROG_H
+
+#include "common.h"
+
+/* Compiled program: a prog_header followed by [size] struct inst_t
+ * records in host byte order and layout, so that the loader maps the
+ * file and uses the records in place */
+#define PROG_MAGIC	0x474f5250	/* "PROG" */
+#define PROG_VERSION	1
+
+struct prog_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t priority;
+	uint32_t size;
+};
+
+/* Parse a program in text form, "priority size" then one instruction
+ * per line, into a malloc'ed text. Return 0, or -1 if it is malformed */
+int prog_parse(FILE * file, uint32_t * priority, struct code_seg_t * code);
+
+/* Map the compiled program at [path], code->text points into the
+ * mapping. Return 0, 1 if [path] is no compiled program, -1 if it is a
+ * broken one */
+int prog_map(const char * path, uint32_t * priority, struct code_seg_t * code);
+
+/* Drop the text of [code], mapped or parsed */
+void prog_release(struct code_seg_t * code);
+
+/* Write [code] in compiled form. Return 0, or -1 on I/O error */
+int prog_write(FILE * file, uint32_t priority, const struct code_seg_t * code);
+
+#endif
+
@@ -4,11 +4,16 @@
 
 #include "common.h"
 
-#define MAX_QUEUE_SIZE 10
+/* Initial number of slots of a queue, it doubles whenever it fills up */
+#define QUEUE_INIT_CAPACITY 8
 
+/* FIFO ring buffer of PCBs. A zero-filled queue_t is a valid empty
+ * queue; storage is allocated on the first enqueue */
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
-	int size;
+	struct pcb_t ** proc;
+	int head;	/* Slot of the oldest process */
+	int size;	/* Number of queued processes */
+	int capacity;	/* Number of slots in [proc] */
 };
 
 void enqueue(struct queue_t * q, struct pcb_t * proc);
@@ -17,5 +22,15 @@ struct pcb_t * dequeue(struct queue_t * q);
 
 int empty(struct queue_t * q);
 
+/* Return the [i]-th process counted from the head of [q] */
+struct pcb_t * queue_at(struct queue_t * q, int i);
+
+/* Remove and return the [i]-th process counted from the head of [q],
+ * keeping the order of the others. Costs O(i) */
+struct pcb_t * queue_remove(struct queue_t * q, int i);
+
+/* Release the storage of [q] and leave it empty */
+void queue_free(struct queue_t * q);
+
 #endif
 
@@ -0,0 +1,39 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include <stddef.h>
+
+/* Intrusive red-black tree. The node is embedded in the struct that is
+ * stored and rb_entry() gets the struct back; the tree itself never
+ * allocates. */
+struct rb_node {
+	struct rb_node * parent;
+	struct rb_node * left;
+	struct rb_node * right;
+	int red;
+};
+
+struct rb_root {
+	struct rb_node * node;
+	struct rb_node * leftmost;	/* Cached smallest node */
+};
+
+#define rb_entry(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+/* Strict ordering of two nodes, equal nodes are inserted after the
+ * ones already in the tree */
+typedef int (*rb_less_t)(const struct rb_node * a, const struct rb_node * b);
+
+void rb_insert(struct rb_root * root, struct rb_node * node, rb_less_t less);
+
+void rb_erase(struct rb_root * root, struct rb_node * node);
+
+/* Smallest node of the tree in O(1), NULL if it is empty */
+struct rb_node * rb_first(struct rb_root * root);
+
+/* In-order successor of [node], NULL for the last one */
+struct rb_node * rb_next(struct rb_node * node);
+
+#endif
+
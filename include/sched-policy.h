@@ -0,0 +1,65 @@
+#ifndef SCHED_POLICY_H
+#define SCHED_POLICY_H
+
+#include "common.h"
+#include "queue.h"
+
+/* Scheduling policy. The scheduler core (sched.c) owns the per-CPU run
+ * queues, their locks, work stealing and the running lists; a policy
+ * only decides the order of the processes waiting in one run queue.
+ * Every callback taking [rq] runs with that run queue locked, except
+ * tick which only touches the running process. */
+struct sched_policy {
+	const char * name;
+
+	/* Allocate the policy state of one run queue */
+	void * (*init)(int time_slot);
+	void (*finish)(void * rq);
+
+	/* Queue a newly loaded process */
+	void (*add)(void * rq, struct pcb_t * proc);
+
+	/* Queue a newly loaded process that preempts the running process
+	 * of this run queue, so that the next get returns it. May be NULL,
+	 * then add is used and the order the policy keeps decides */
+	void (*add_preempting)(void * rq, struct pcb_t * proc);
+
+	/* Queue a process again after it ran */
+	void (*put)(void * rq, struct pcb_t * proc);
+
+	/* Take the next process to run on CPU [cpu], NULL if none is
+	 * queued. [cpu] may belong to another run queue when it steals */
+	struct pcb_t * (*get)(void * rq, int cpu);
+
+	/* Called after each instruction of a running process, which has
+	 * run proc->run_ticks instructions since its dispatch. Return 1
+	 * when it has to give the CPU up */
+	int (*tick)(void * rq, struct pcb_t * proc);
+
+	/* Return 1 when the new process [proc] should take the CPU from
+	 * [curr] right away. May be NULL, then arrivals never preempt. Runs
+	 * with the run queue of [curr] locked */
+	int (*preempt)(struct pcb_t * proc, struct pcb_t * curr);
+
+	/* Call [fn] on every queued process */
+	void (*for_each)(void * rq, void (*fn)(struct pcb_t *, void *),
+			void * arg);
+};
+
+/* Number of processes at the head of a queue that a policy looks at to
+ * find one that is warm in the cache of the dispatching CPU */
+#define SCHED_AFFINITY_SCAN	4
+
+/* Take a process from the head of [q] for CPU [cpu]: the first of the
+ * SCHED_AFFINITY_SCAN oldest that last ran on [cpu], else the first that
+ * never ran, else the oldest. With [cpu] < 0, simply the oldest */
+struct pcb_t * sched_affinity_dequeue(struct queue_t * q, int cpu);
+
+extern struct sched_policy sched_fifo_policy;
+extern struct sched_policy sched_rr_policy;
+extern struct sched_policy sched_mlq_policy;
+extern struct sched_policy sched_mlfq_policy;
+extern struct sched_policy sched_cfs_policy;
+
+#endif
+
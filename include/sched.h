@@ -1,28 +1,65 @@
-#ifndef QUEUE_H
-#define QUEUE_H
+#ifndef SCHED_H
+#define SCHED_H
 
 #include "common.h"
 
-#ifndef MLQ_SCHED
-#define MLQ_SCHED
-#endif
-
 #define MAX_PRIO 140
 
 int queue_empty(void);
 
-void init_scheduler(void);
+/* Set up one run queue per simulated CPU, ordered by the policy called
+ * [policy] ("fifo", "rr", "mlq", "mlfq" or "cfs"). Processes with a
+ * deadline bypass the policy: they run earliest deadline first, ahead
+ * of every other process. With [preempt] set, a new process that
+ * outranks a running one makes it yield at its next instruction.
+ * Return -1 if there is no such policy */
+int init_scheduler(int num_cpus, int time_slot, const char * policy,
+		int preempt);
 void finish_scheduler(void);
 
-/* Get the next process from ready queue */
-struct pcb_t * get_proc(void);
+/* Tell whether CPUs call into the scheduler from several host threads.
+ * Without them the run queue locks are skipped */
+void sched_set_threaded(int threaded);
+
+/* Have [wake] called whenever a process is queued, so that the caller
+ * can bring back a CPU it let sleep while the queues were empty */
+void sched_set_wake(void (*wake)(void));
 
-/* Put a process back to run queue */
-void put_proc(struct pcb_t * proc);
+/* Get the next process for CPU [cpu], stealing from a peer CPU
+ * when its own run queue is empty */
+struct pcb_t * get_proc(int cpu);
 
-/* Add a new process to ready queue */
+/* Put a process back to the run queue of the CPU it ran on */
+void put_proc(int cpu, struct pcb_t * proc);
+
+/* Add a new process to the ready queue of the least loaded online CPU,
+ * or of the CPU it preempts */
 void add_proc(struct pcb_t * proc);
 
+/* Let CPU [cpu] take new processes again */
+void sched_cpu_online(int cpu);
+
+/* Stop placing processes on CPU [cpu] and move the ones queued there
+ * to the online CPUs. The CPU must not be running a process */
+void sched_cpu_offline(int cpu);
+
+/* Drop a finished process from the running list of CPU [cpu] and
+ * account whether it met its deadline */
+void exit_proc(int cpu, struct pcb_t * proc);
+
+/* Account one executed instruction of [proc] running on CPU [cpu].
+ * Return 1 if the process has to give the CPU up, because its slice is
+ * over or because it was preempted */
+int sched_tick(int cpu, struct pcb_t * proc);
+
+/* Call [fn] on every process a CPU is currently running */
+void sched_for_each_running(void (*fn)(struct pcb_t *, void *), void * arg);
+
+/* Call [fn] on every process waiting in a run queue. Each queue is
+ * locked while it is visited, so [fn] must not call back into the
+ * scheduler */
+void sched_for_each_queued(void (*fn)(struct pcb_t *, void *), void * arg);
+
 #endif
 
 
@@ -0,0 +1,33 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* State of one simulation. The modules keep theirs here rather than in
+ * file-static variables, so that one process can run several
+ * simulations side by side. Each module owns the layout of its part */
+struct sim_ctx {
+	FILE * out;			/* Where the trace goes */
+	struct os_ctx * os;		/* Config, loader and CPUs (os.c) */
+	struct sched_ctx * sched;	/* Run queues (sched.c) */
+	struct timer_ctx * timer;	/* Clock (timer.c) */
+	uint32_t avail_pid;		/* Next PID to hand out (os.c) */
+};
+
+/* Simulation the calling host thread works for */
+extern __thread struct sim_ctx * sim;
+
+/* New simulation printing its trace to [out] */
+struct sim_ctx * sim_create(FILE * out);
+void sim_destroy(struct sim_ctx * ctx);
+
+/* printf() to the trace of the current simulation */
+void sim_printf(const char * fmt, ...)
+	__attribute__((format(printf, 1, 2)));
+
+/* pthread_create() for a thread working for the current simulation */
+int sim_thread_create(pthread_t * thread, void * (*fn)(void *), void * arg);
+
+#endif
@@ -4,25 +4,78 @@
 #include <pthread.h>
 #include <stdint.h>
 
+/* A device taking part in the clock, e.g. a CPU or the loader */
 struct timer_id_t {
-	int done;
-	int fsh;
-	pthread_cond_t event_cond;
-	pthread_mutex_t event_lock;
-	pthread_cond_t timer_cond;
-	pthread_mutex_t timer_lock;
+	int fsh;	/* Detached, the clock no longer waits for it */
+	uint64_t local;	/* Local clock, may run ahead in PDES mode */
 };
 
+/* Set up the clock of the current simulation, before any other call.
+ * stop_timer() tears it down */
+void init_timer();
+
 void start_timer();
 
 void stop_timer();
 
+/* Add a device to the clock. Once the clock runs, only a device that is
+ * attached itself may call it, from within a slot, so that the slot
+ * cannot close before the new device took part in it */
 struct timer_id_t * attach_event();
 
 void detach_event(struct timer_id_t * event);
 
+/* Take an attached device out of the clock until timer_unpark(): the
+ * slots no longer wait for it. For a device that has nothing to do
+ * until another one hands it work */
+void timer_park(struct timer_id_t * event);
+
+/* Count a parked device in again from the current slot. Only a device
+ * that is attached itself may call it, from within a slot, as for
+ * attach_event() */
+void timer_unpark(struct timer_id_t * event);
+
+/* Wait until every attached device is done with the current slot. The
+ * last one to arrive advances the clock */
 void next_slot(struct timer_id_t* timer_id);
 
+/* No event of the device before this slot */
+#define TIMER_NEVER	UINT64_MAX
+
+/* Like next_slot(), for a device that has nothing to do before slot
+ * [wake]. With fast-forward on, the clock jumps to the earliest slot
+ * some device needs rather than stepping through idle ones */
+void next_slot_until(struct timer_id_t * timer_id, uint64_t wake);
+
+/* Enable fast-forward, before start_timer() */
+void timer_fast_forward(int enable);
+
+/* End the current slot of a device whose next slot touches no shared
+ * state. In lockstep mode this is next_slot(); in PDES mode the device
+ * runs on without waiting for the others */
+void timer_advance(struct timer_id_t * timer_id);
+
+/* Wait until the clock catches up with the local slot of a device
+ * that ran ahead in PDES mode, before it touches shared state */
+void timer_sync(struct timer_id_t * timer_id);
+
+/* Most slots one timer_skip() may cover */
+#define TIMER_MAX_SKIP	63
+
+/* End the current slot of a device and the [n] - 1 after it, none of
+ * which touch shared state, at once. The device leaves the barrier and
+ * returns once the clock reaches the slot after them. [n] is at most
+ * TIMER_MAX_SKIP */
+void timer_skip(struct timer_id_t * timer_id, uint64_t n);
+
+/* Enable the parallel discrete-event mode, before start_timer(). Wake
+ * times are ignored then, it does not combine with fast-forward */
+void timer_pdes(int enable);
+
 uint64_t current_time();
 
+/* Move the clock to [slot] directly, for a run that steps its devices
+ * itself instead of having them wait on the clock */
+void timer_jump(uint64_t slot);
+
 #endif
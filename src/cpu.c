@@ -5,6 +5,8 @@
 #include "syscall.h"
 #include "libmem.h"
 
+#include <stdlib.h>
+
 int calc(struct pcb_t *proc)
 {
 	return ((unsigned long)proc & 0UL);
@@ -58,55 +60,135 @@ int write(
 	return write_mem(proc->regs[destination] + offset, proc, data);
 }
 
+static int exec_calc(struct pcb_t *proc, const struct dinst_t *ins)
+{
+	return calc(proc);
+}
+
+#ifdef MM_PAGING
+static int exec_alloc(struct pcb_t *proc, const struct dinst_t *ins)
+{
+	return liballoc(proc, ins->arg_0, ins->arg_1);
+}
+
+static int exec_free(struct pcb_t *proc, const struct dinst_t *ins)
+{
+	return libfree(proc, ins->arg_0);
+}
+
+static int exec_read(struct pcb_t *proc, const struct dinst_t *ins)
+{
+	/* The byte read is dropped, the text stays read-only */
+	uint32_t data;
+	return libread(proc, ins->arg_0, ins->arg_1, &data);
+}
+
+static int exec_write(struct pcb_t *proc, const struct dinst_t *ins)
+{
+	return libwrite(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+#else
+static int exec_alloc(struct pcb_t *proc, const struct dinst_t *ins)
+{
+	return alloc(proc, ins->arg_0, ins->arg_1);
+}
+
+static int exec_free(struct pcb_t *proc, const struct dinst_t *ins)
+{
+	return free_data(proc, ins->arg_0);
+}
+
+static int exec_read(struct pcb_t *proc, const struct dinst_t *ins)
+{
+	return read(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+static int exec_write(struct pcb_t *proc, const struct dinst_t *ins)
+{
+	return write(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+#endif
+
+static int exec_syscall(struct pcb_t *proc, const struct dinst_t *ins)
+{
+	return libsyscall(proc, ins->arg_0, ins->arg_1, ins->arg_2, ins->arg_3);
+}
+
+static int exec_invalid(struct pcb_t *proc, const struct dinst_t *ins)
+{
+	return 1;
+}
+
+static const inst_handler_t handlers[] = {
+	[CALC] = exec_calc,
+	[ALLOC] = exec_alloc,
+	[FREE] = exec_free,
+	[READ] = exec_read,
+	[WRITE] = exec_write,
+	[SYSCALL] = exec_syscall,
+};
+
+void decode(struct code_seg_t *code)
+{
+	uint32_t i;
+
+	code->ops = malloc(sizeof(struct dinst_t) * code->size);
+	for (i = 0; i < code->size; i++)
+	{
+		struct inst_t *ins = &code->text[i];
+		struct dinst_t *op = &code->ops[i];
+		op->handler = (unsigned)ins->opcode <
+				sizeof(handlers) / sizeof(handlers[0]) ?
+			handlers[ins->opcode] : exec_invalid;
+		op->arg_0 = ins->arg_0;
+		op->arg_1 = ins->arg_1;
+		op->arg_2 = ins->arg_2;
+		op->arg_3 = ins->arg_3;
+	}
+
+	/* Runs of CALC are counted backwards, so that the head of a run
+	 * knows its length */
+	for (i = code->size; i-- > 0;)
+	{
+		struct dinst_t *op = &code->ops[i];
+		if (code->text[i].opcode != CALC)
+			op->calc_run = 0;
+		else if (i + 1 < code->size)
+			op->calc_run = code->ops[i + 1].calc_run + 1;
+		else
+			op->calc_run = 1;
+	}
+}
+
+uint32_t calc_run(struct pcb_t *proc)
+{
+	if (proc->pc >= proc->code->size)
+	{
+		return 0;
+	}
+	return proc->code->ops[proc->pc].calc_run;
+}
+
+void run_calc(struct pcb_t *proc, uint32_t n)
+{
+	/* CALC only takes time. A process killed meanwhile stays at its
+	 * end */
+	if (proc->pc + n > proc->code->size)
+		n = proc->code->size - proc->pc;
+	proc->pc += n;
+}
+
 int run(struct pcb_t *proc)
 {
+	const struct dinst_t *ins;
+
 	/* Check if Program Counter point to the proper instruction */
 	if (proc->pc >= proc->code->size)
 	{
 		return 1;
 	}
 
-	struct inst_t ins = proc->code->text[proc->pc];
+	ins = &proc->code->ops[proc->pc];
 	proc->pc++;
-	int stat = 1;
-switch (ins.opcode)
-	{
-	case CALC:
-		stat = calc(proc);
-		break;
-	case ALLOC:
-#ifdef MM_PAGING
-		stat = liballoc(proc, ins.arg_0, ins.arg_1);
-#else
-		stat = alloc(proc, ins.arg_0, ins.arg_1);
-#endif
-		break;
-	case FREE:
-#ifdef MM_PAGING
-		stat = libfree(proc, ins.arg_0);
-#else
-		stat = free_data(proc, ins.arg_0);
-#endif
-		break;
-	case READ:
-#ifdef MM_PAGING
-		stat = libread(proc, ins.arg_0, ins.arg_1, &ins.arg_2);
-#else
-		stat = read(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#endif
-		break;
-	case WRITE:
-#ifdef MM_PAGING
-		stat = libwrite(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#else
-		stat = write(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#endif
-		break;
-	case SYSCALL:
-		stat = libsyscall(proc, ins.arg_0, ins.arg_1, ins.arg_2, ins.arg_3);
-		break;
-	default:
-		stat = 1;
-	}
-	return stat;
+	return ins->handler(proc, ins);
 }
@@ -18,6 +18,7 @@
  #include "mm.h"
  #include "syscall.h"
  #include "libmem.h"
+ #include "sim.h"
  #include <stdlib.h>
  #include <stdio.h>
  #include <pthread.h>
@@ -132,7 +133,7 @@
   */
  int __free(struct pcb_t *caller, int vmaid, int rgid)
  {
-   printf("[DEBUG] __free: Freeing memory region, vmaid=%d, rgid=%d\n", vmaid, rgid);
+   sim_printf("[DEBUG] __free: Freeing memory region, vmaid=%d, rgid=%d\n", vmaid, rgid);
  //  
    // Dummy initialization for avoding compiler dummay warning
    // in incompleted TODO code rgnode will overwrite through implementing
@@ -147,14 +148,14 @@
    // get the region needs to free
    struct vm_rg_struct* free_rg = &caller->mm->symrgtbl[rgid];
    if (free_rg->rg_start >= free_rg->rg_end){
-     printf("[ERROR] __free: Invalid region bounds: start=%d, end=%d\n", free_rg->rg_start, free_rg->rg_end);
+     sim_printf("[ERROR] __free: Invalid region bounds: start=%d, end=%d\n", free_rg->rg_start, free_rg->rg_end);
      pthread_mutex_unlock(&mmvm_lock);
      return -1;
    }
  
    struct vm_area_struct* cur_vma = get_vma_by_num(caller->mm, vmaid);
    if (!cur_vma){
-     printf("[ERROR] __free: Failed to get vma for vmaid=%d\n", vmaid);
+     sim_printf("[ERROR] __free: Failed to get vma for vmaid=%d\n", vmaid);
      pthread_mutex_unlock(&mmvm_lock);
      return -1;
    }
@@ -162,7 +163,7 @@
    // create a region to replace the region needs to remove
    struct vm_rg_struct* new_free_rg = malloc(sizeof(struct vm_rg_struct));
    if (!new_free_rg){
-     printf("[ERROR] __free: Failed to allocate memory for new free region\n");
+     sim_printf("[ERROR] __free: Failed to allocate memory for new free region\n");
      pthread_mutex_unlock(&mmvm_lock);
      return -1;
    }
@@ -170,7 +171,7 @@
    // replace the removed rg (free_rg) by new_free_rg and add it to freerg_list
    new_free_rg->rg_start = free_rg->rg_start;
    new_free_rg->rg_end = free_rg->rg_end;
-   printf("[DEBUG] __free: Adding region to free list: %d to %d\n", new_free_rg->rg_start, new_free_rg->rg_end);
+   sim_printf("[DEBUG] __free: Adding region to free list: %d to %d\n", new_free_rg->rg_start, new_free_rg->rg_end);
    enlist_vm_freerg_list(caller->mm, new_free_rg);
  
    // delete info of free_rg in vmem
@@ -206,7 +207,7 @@
  int libfree(struct pcb_t *proc, uint32_t reg_index)
  {
    /* TODO Implement free region */
-   printf("[DEBUG] libfree: Called with reg_index=%u\n", reg_index);
+   sim_printf("[DEBUG] libfree: Called with reg_index=%u\n", reg_index);
  
    /* By default using vmaid = 0 */
    return __free(proc, 0, reg_index);
@@ -392,20 +393,20 @@
    int off = PAGING_OFFST(addr);
    int fpn;
  
-   printf("[DEBUG] pg_setval: Writing to addr=%d, pgn=%d, offset=%d, value=%d\n", addr, pgn, off, value);
+   sim_printf("[DEBUG] pg_setval: Writing to addr=%d, pgn=%d, offset=%d, value=%d\n", addr, pgn, off, value);
  
    /* Get the page to MEMRAM, swap from MEMSWAP if needed */
    if (pg_getpage(mm, pgn, &fpn, caller) != 0) {
-     printf("[ERROR] pg_setval: Failed to get page\n");
+     sim_printf("[ERROR] pg_setval: Failed to get page\n");
      return -1; /* invalid page access */
    }
  
    int phy_addr = (fpn << PAGING_ADDR_FPN_LOBIT) + off;
-   printf("[DEBUG] pg_setval: Writing to physical address=%d\n", phy_addr);
+   sim_printf("[DEBUG] pg_setval: Writing to physical address=%d\n", phy_addr);
    
    int write_result = MEMPHY_write(caller->mram, phy_addr, value);
    if (write_result != 0) {
-     printf("[ERROR] pg_setval: Failed to write to memory, result=%d\n", write_result);
+     sim_printf("[ERROR] pg_setval: Failed to write to memory, result=%d\n", write_result);
      return -1;
    }
    
@@ -422,20 +423,20 @@
   */
  int __read(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *data)
  {
-   printf("[DEBUG] __read: vmaid=%d, rgid=%d, offset=%d\n", vmaid, rgid, offset);
+   sim_printf("[DEBUG] __read: vmaid=%d, rgid=%d, offset=%d\n", vmaid, rgid, offset);
    
    struct vm_rg_struct *currg = get_symrg_byid(caller->mm, rgid);
    struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
  
    if (currg == NULL || cur_vma == NULL) { /* Invalid memory identify */
-     printf("[ERROR] __read: Invalid region or VMA\n");
+     sim_printf("[ERROR] __read: Invalid region or VMA\n");
      return -1;
    }
  
-   printf("[DEBUG] __read: Reading from virtual address=%d\n", currg->rg_start + offset);
+   sim_printf("[DEBUG] __read: Reading from virtual address=%d\n", currg->rg_start + offset);
    int result = pg_getval(caller->mm, currg->rg_start + offset, data, caller);
    if (result != 0) {
-     printf("[ERROR] __read: Failed to get value\n");
+     sim_printf("[ERROR] __read: Failed to get value\n");
    }
  
    return result;
@@ -455,10 +456,10 @@
  
    if (val == 0 && destination != NULL) {
      *destination = data;
-     printf("[DEBUG] ibread: Read successful, value=%u\n", data);
+     sim_printf("[DEBUG] ibread: Read successful, value=%u\n", data);
    } else {
      *destination = -1 ;// no data to read, set to -1 so the sycall stop to read
-     printf("[ERROR] libread: Read failed or destination is NULL\n");
+     sim_printf("[ERROR] libread: Read failed or destination is NULL\n");
      return -1;
    }
  
@@ -512,7 +513,7 @@
   // printf("[DEBUG] libwrite: data=%u, destination=%u, offset=%u\n", data, destination, offset);
  
  #ifdef IODUMP
-   printf("write region=%d offset=%d value=%d\n", destination, offset, data);
+   sim_printf("write region=%d offset=%d value=%d\n", destination, offset, data);
  #ifdef PAGETBL_DUMP
    print_pgtbl(proc, 0, -1); // print max TBL
  #endif
@@ -553,7 +554,7 @@
      }
    }
  
-   printf("[DEBUG] free_pcb_memph: Completed\n");
+   sim_printf("[DEBUG] free_pcb_memph: Completed\n");
    return 0;
  }
  
@@ -1,105 +1,155 @@
 
 #include "loader.h"
+#include "cpu.h"
+#include "prog.h"
+#include "mm.h"
+#include "sim.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static uint32_t avail_pid = 1;
-
-#define OPT_CALC	"calc"
-#define OPT_ALLOC	"alloc"
-#define OPT_FREE	"free"
-#define OPT_READ	"read"
-#define OPT_WRITE	"write"
-#define OPT_SYSCALL	"syscall"
-
-static enum ins_opcode_t get_opcode(char * opt) {
-	if (!strcmp(opt, OPT_CALC)) {
-		return CALC;
-	}else if (!strcmp(opt, OPT_ALLOC)) {
-		return ALLOC;
-	}else if (!strcmp(opt, OPT_FREE)) {
-		return FREE;
-	}else if (!strcmp(opt, OPT_READ)) {
-		return READ;
-	}else if (!strcmp(opt, OPT_WRITE)) {
-		return WRITE;
-	}else if (!strcmp(opt, OPT_SYSCALL)) {
-		return SYSCALL;
-	}else{
-		printf("get_opcode return Opcode: %s\n", opt);
-		exit(1);
+/* Programs in use, keyed by path. Every process running a program
+ * shares its code, which is read-only once loaded, so the cache serves
+ * all the simulations of the host process alike */
+struct prog_entry {
+	char * path;
+	uint32_t priority;
+	struct code_seg_t * code;
+	struct prog_entry * next;
+};
+
+static struct prog_entry * prog_cache;
+static pthread_mutex_t prog_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Take a reference on the cached entry for [path], NULL if there is
+ * none. The caller holds prog_cache_lock */
+static struct prog_entry * prog_cache_get(const char * path) {
+	struct prog_entry * e;
+
+	for (e = prog_cache; e != NULL; e = e->next) {
+		if (!strcmp(e->path, path)) {
+			e->code->refs++;
+			return e;
+		}
+	}
+	return NULL;
+}
+
+/* Read the program at [path], a compiled one is mapped and a text one
+ * parsed */
+static struct code_seg_t * code_read(const char * path, uint32_t * priority) {
+	struct code_seg_t * code = malloc(sizeof(struct code_seg_t));
+	int ret = prog_map(path, priority, code);
+
+	if (ret > 0) {
+		FILE * file;
+		if ((file = fopen(path, "r")) == NULL) {
+			sim_printf("Cannot find process description at '%s'\n",
+				path);
+			ret = -1;
+		}else{
+			ret = prog_parse(file, priority, code);
+			fclose(file);
+		}
+	}
+	if (ret < 0) {
+		free(code);
+		return NULL;
 	}
+	/* The mapping is read-only, so a compiled program is decoded
+	 * into a copy too. The copy is made once per program, the cache
+	 * shares it with every load */
+	decode(code);
+	code->refs = 1;
+	return code;
+}
+
+static void code_free(struct code_seg_t * code) {
+	prog_release(code);
+	free(code->ops);
+	free(code);
+}
+
+/* Code of the program at [path], shared with the processes already
+ * running it */
+static struct code_seg_t * code_get(const char * path, uint32_t * priority) {
+	struct prog_entry * e;
+	struct code_seg_t * code;
+
+	pthread_mutex_lock(&prog_cache_lock);
+	e = prog_cache_get(path);
+	pthread_mutex_unlock(&prog_cache_lock);
+	if (e != NULL) {
+		*priority = e->priority;
+		return e->code;
+	}
+
+	/* Read it without the lock, another loader may beat us to it */
+	if ((code = code_read(path, priority)) == NULL)
+		return NULL;
+	pthread_mutex_lock(&prog_cache_lock);
+	if ((e = prog_cache_get(path)) != NULL) {
+		pthread_mutex_unlock(&prog_cache_lock);
+		code_free(code);
+		*priority = e->priority;
+		return e->code;
+	}
+	e = malloc(sizeof(struct prog_entry));
+	e->path = strdup(path);
+	e->priority = *priority;
+	e->code = code;
+	e->next = prog_cache;
+	prog_cache = e;
+	pthread_mutex_unlock(&prog_cache_lock);
+	return code;
+}
+
+/* Drop a reference on [code], the last one frees it */
+static void code_put(struct code_seg_t * code) {
+	struct prog_entry ** pe, * e;
+
+	pthread_mutex_lock(&prog_cache_lock);
+	if (--code->refs > 0) {
+		pthread_mutex_unlock(&prog_cache_lock);
+		return;
+	}
+	for (pe = &prog_cache; (*pe)->code != code; pe = &(*pe)->next)
+		;
+	e = *pe;
+	*pe = e->next;
+	pthread_mutex_unlock(&prog_cache_lock);
+
+	code_free(code);
+	free(e->path);
+	free(e);
 }
 
 struct pcb_t * load(const char * path) {
 	/* Create new PCB for the new process */
-	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
-	proc->pid = avail_pid;
-	avail_pid++;
+	struct pcb_t * proc = (struct pcb_t * )calloc(1, sizeof(struct pcb_t));
+	proc->code = code_get(path, &proc->priority);
+	if (proc->code == NULL) {
+		free(proc);
+		return NULL;
+	}
+
+	proc->pid = 0;
 	proc->page_table =
 		(struct page_table_t*)malloc(sizeof(struct page_table_t));
 	proc->bp = PAGE_SIZE;
 	proc->pc = 0;
-
-	/* Read process code from file */
-	FILE * file;
-	if ((file = fopen(path, "r")) == NULL) {
-		printf("Cannot find process description at '%s'\n", path);
-		exit(1);		
-	}
 	snprintf(proc->path, 2*sizeof(path)+1, "%s", path);
-	char opcode[10];
-	proc->code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
-	fscanf(file, "%u %u", &proc->priority, &proc->code->size);
-	proc->code->text = (struct inst_t*)malloc(
-		sizeof(struct inst_t) * proc->code->size
-	);
-	uint32_t i = 0;
-	char buf[200];
-	for (i = 0; i < proc->code->size; i++) {
-		fscanf(file, "%s", opcode);
-		proc->code->text[i].opcode = get_opcode(opcode);
-		switch(proc->code->text[i].opcode) {
-		case CALC:
-			break;
-		case ALLOC:
-			fscanf(
-				file,
-				"%u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1
-			);
-			break;
-		case FREE:
-			fscanf(file, "%u\n", &proc->code->text[i].arg_0);
-			break;
-		case READ: // đù chưa làm nè
-		case WRITE:
-			fscanf(
-				file,
-				"%u %u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1,
-				&proc->code->text[i].arg_2
-			);
-			break;	
-		case SYSCALL:
-			fgets(buf, sizeof(buf), file);
-			sscanf(buf, "%d%d%d%d",
-			           &proc->code->text[i].arg_0,
-			           &proc->code->text[i].arg_1,
-			           &proc->code->text[i].arg_2,
-			           &proc->code->text[i].arg_3
-			);
-			break;
-		default:
-			printf("Opcode: %s\n", opcode);
-			exit(1);
-		}
-	}
 	return proc;
 }
 
-
+void unload(struct pcb_t * proc) {
+	code_put(proc->code);
+#ifdef MM_PAGING
+	if (proc->mm != NULL)
+		free_mm(proc->mm);
+#endif
+	free(proc->page_table);
+	free(proc);
+}
 
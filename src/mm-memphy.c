@@ -187,6 +187,8 @@ int init_memphy(struct memphy_struct *mp, int max_size, int randomflg)
    mp->storage = (BYTE *)malloc(max_size * sizeof(BYTE));
    mp->maxsz = max_size;
    memset(mp->storage, 0, max_size * sizeof(BYTE));
+   mp->free_fp_list = NULL;
+   mp->used_fp_list = NULL;
 
    MEMPHY_format(mp, PAGING_PAGESZ);
 
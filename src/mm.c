@@ -5,6 +5,7 @@
  */
 
 #include "mm.h"
+#include "sim.h"
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -144,6 +145,7 @@ int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struc
   int pgit, fpn;
   struct framephy_struct *newfp_str = malloc(sizeof(struct framephy_struct)); // Cấp phát bộ nhớ cho khung vật lý mới.
    struct framephy_struct *fp = newfp_str; // Khởi tạo con trỏ khung vật lý.
+  newfp_str->fp_next = NULL;
 
   /* TODO: allocate the page 
   //caller-> ...
@@ -159,6 +161,7 @@ int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struc
       fp->fp_next = malloc(sizeof(struct framephy_struct)); // Cấp phát bộ nhớ cho khung vật lý tiếp theo.
       fp = fp->fp_next; // Di chuyển đến khung bộ nhớ tiếp theo.
       fp->fpn = fpn; // Gán số khung bộ nhớ vật lý vào khung bộ nhớ.
+      fp->fp_next = NULL;
     }
     else
     { 
@@ -205,7 +208,7 @@ int vm_map_ram(struct pcb_t *caller, int astart, int aend, int mapstart, int inc
   if (ret_alloc == -3000)
   {
 #ifdef MMDBG
-    printf("OOM: vm_map_ram out of memory \n");
+    sim_printf("OOM: vm_map_ram out of memory \n");
 #endif
     return -1;
   }
@@ -252,7 +255,7 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   if(vma0 == NULL){
     return -1; // Trả về lỗi nếu không thể cấp phát bộ nhớ cho vùng ảo.
   }
-  mm->pgd = malloc(PAGING_MAX_PGN * sizeof(uint32_t));
+  mm->pgd = calloc(PAGING_MAX_PGN, sizeof(uint32_t));
   if (mm->pgd == NULL)
    {  
     free(vma0); // Giải phóng bộ nhớ đã cấp phát cho vùng ảo.
@@ -264,6 +267,7 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   vma0->vm_end = vma0->vm_start;
   vma0->sbrk = vma0->vm_start;
   struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
+  vma0->vm_freerg_list = NULL;
   enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
 
   /* TODO update VMA0 next */
@@ -277,6 +281,33 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   return 0;
 }
 
+/*
+ *Release the host memory of a Memory Management instance, the frames
+ *it mapped stay as they are
+ * @mm:     self mm
+ */
+void free_mm(struct mm_struct *mm)
+{
+  struct vm_area_struct *vma, *next_vma;
+  struct vm_rg_struct *rg, *next_rg;
+  struct pgn_t *pg, *next_pg;
+
+  for (vma = mm->mmap; vma != NULL; vma = next_vma) {
+    for (rg = vma->vm_freerg_list; rg != NULL; rg = next_rg) {
+      next_rg = rg->rg_next;
+      free(rg);
+    }
+    next_vma = vma->vm_next;
+    free(vma);
+  }
+  for (pg = mm->fifo_pgn; pg != NULL; pg = next_pg) {
+    next_pg = pg->pg_next;
+    free(pg);
+  }
+  free(mm->pgd);
+  free(mm);
+}
+
 struct vm_rg_struct *init_vm_rg(int rg_start, int rg_end)
 {
   struct vm_rg_struct *rgnode = malloc(sizeof(struct vm_rg_struct));
@@ -311,15 +342,15 @@ int print_list_fp(struct framephy_struct *ifp)
 {
   struct framephy_struct *fp = ifp;
 
-  printf("print_list_fp: ");
-  if (fp == NULL) { printf("NULL list\n"); return -1;}
-  printf("\n");
+  sim_printf("print_list_fp: ");
+  if (fp == NULL) { sim_printf("NULL list\n"); return -1;}
+  sim_printf("\n");
   while (fp != NULL)
   {
-    printf("fp[%d]\n", fp->fpn);
+    sim_printf("fp[%d]\n", fp->fpn);
     fp = fp->fp_next;
   }
-  printf("\n");
+  sim_printf("\n");
   return 0;
 }
 
@@ -327,15 +358,15 @@ int print_list_rg(struct vm_rg_struct *irg)
 {
   struct vm_rg_struct *rg = irg;
 
-  printf("print_list_rg: ");
-  if (rg == NULL) { printf("NULL list\n"); return -1; }
-  printf("\n");
+  sim_printf("print_list_rg: ");
+  if (rg == NULL) { sim_printf("NULL list\n"); return -1; }
+  sim_printf("\n");
   while (rg != NULL)
   {
-    printf("rg[%ld->%ld]\n", rg->rg_start, rg->rg_end);
+    sim_printf("rg[%ld->%ld]\n", rg->rg_start, rg->rg_end);
     rg = rg->rg_next;
   }
-  printf("\n");
+  sim_printf("\n");
   return 0;
 }
 
@@ -343,29 +374,29 @@ int print_list_vma(struct vm_area_struct *ivma)
 {
   struct vm_area_struct *vma = ivma;
 
-  printf("print_list_vma: ");
-  if (vma == NULL) { printf("NULL list\n"); return -1; }
-  printf("\n");
+  sim_printf("print_list_vma: ");
+  if (vma == NULL) { sim_printf("NULL list\n"); return -1; }
+  sim_printf("\n");
   while (vma != NULL)
   {
-    printf("va[%ld->%ld]\n", vma->vm_start, vma->vm_end);
+    sim_printf("va[%ld->%ld]\n", vma->vm_start, vma->vm_end);
     vma = vma->vm_next;
   }
-  printf("\n");
+  sim_printf("\n");
   return 0;
 }
 
 int print_list_pgn(struct pgn_t *ip)
 {
-  printf("print_list_pgn: ");
-  if (ip == NULL) { printf("NULL list\n"); return -1; }
-  printf("\n");
+  sim_printf("print_list_pgn: ");
+  if (ip == NULL) { sim_printf("NULL list\n"); return -1; }
+  sim_printf("\n");
   while (ip != NULL)
   {
-    printf("va[%d]-\n", ip->pgn);
+    sim_printf("va[%d]-\n", ip->pgn);
     ip = ip->pg_next;
   }
-  printf("n");
+  sim_printf("n");
   return 0;
 }
 
@@ -383,13 +414,13 @@ int print_pgtbl(struct pcb_t *caller, uint32_t start, uint32_t end)
   pgn_start = PAGING_PGN(start);
   pgn_end = PAGING_PGN(end);
 
-  printf("print_pgtbl: %d - %d", start, end);
-  if (caller == NULL) { printf("NULL caller\n"); return -1;}
-  printf("\n");
+  sim_printf("print_pgtbl: %d - %d", start, end);
+  if (caller == NULL) { sim_printf("NULL caller\n"); return -1;}
+  sim_printf("\n");
 
   for (pgit = pgn_start; pgit < pgn_end; pgit++)
   {
-    printf("%08ld: %08x\n", pgit * sizeof(uint32_t), caller->mm->pgd[pgit]);
+    sim_printf("%08ld: %08x\n", pgit * sizeof(uint32_t), caller->mm->pgd[pgit]);
   }
 
   return 0;
@@ -4,21 +4,43 @@
 #include "sched.h"
 #include "loader.h"
 #include "mm.h"
+#include "pool.h"
+#include "sim.h"
 
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include<ctype.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
-static int time_slot;
-static int num_cpus;
-static int done = 0;
+/* Where a batch writes the traces unless told otherwise */
+#define BATCH_OUTPUT_DIR "output/batch"
 
-#ifdef MM_PAGING
-static int memramsz;
-static int memswpsz[PAGING_MAX_MMSWP];
+/* How devices map onto host threads */
+enum engine {
+	ENGINE_THREADS,		/* One thread per device */
+	ENGINE_SINGLE,		/* Every device on the main thread */
+	ENGINE_POOL,		/* Devices stepped by a pool of threads */
+};
+
+/* CPU hot-plug plan: from slot [time] on, [nr_cpus] CPUs are online */
+#define MAX_CPU_EVENTS 64
+struct cpu_event {
+	unsigned long time;
+	int nr_cpus;
+};
 
+/* Arrivals built ahead of their start time, and how many of them a
+ * prefetch round builds at most */
+#define LD_PREFETCH 64
+#define LD_PREFETCH_ROUND 16
+
+#define LD_SLOT(os, i) ((i) % (os)->ld_cap)
+
+#ifdef MM_PAGING
 struct mmpaging_ld_args {
 	/* A dispatched argument struct to compact many-fields passing to loader */
 	int vmemsz;
@@ -30,142 +52,850 @@ struct mmpaging_ld_args {
 };
 #endif
 
-static struct ld_args{
+struct ld_args{
 	char ** path;
 	unsigned long * start_time;
-#ifdef MLQ_SCHED
 	unsigned long * prio;
-#endif
-} ld_processes;
-int num_processes;
+	unsigned long * deadline;	/* Relative to the arrival, 0 if none */
+};
+
+enum cpu_state {
+	CPU_ONLINE,
+	CPU_STOPPING,	/* Asked to go offline at its next slot */
+	CPU_OFFLINE,
+};
+
+/* How a CPU ends its slot */
+enum cpu_step {
+	CPU_STEP_NEXT,		/* It needs the next slot */
+	CPU_STEP_AHEAD,		/* It only computes in the next slot */
+	CPU_STEP_SKIP,		/* It already computed its next skip - 1 slots */
+	CPU_STEP_IDLE,		/* Nothing to run until the loader brings work */
+	CPU_STEP_OFFLINE,	/* It went offline */
+	CPU_STEP_STOPPED,	/* No more work will come */
+};
 
 struct cpu_args {
 	struct timer_id_t * timer_id;
 	int id;
+
+	/* State kept between slots */
+	struct pcb_t * proc;	/* Current process */
+	int dispatched;		/* The current process has the CPU */
+	int synced;		/* In step with the clock, not ahead of it */
+	uint64_t skip;		/* Slots covered by the last step */
+	uint64_t resume;	/* First slot after them */
+
+	/* Hot-plug state, changed by the loader and the CPU itself under
+	 * lock, [state] is also read without it */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	enum cpu_state state;
+
+	/* Idle and out of the clock, waiting on idle_cond for work */
+	int parked;
+	pthread_cond_t idle_cond;
+};
+
+/* Config, loader and CPUs of a simulation, sim->os */
+struct os_ctx {
+	int time_slot;
+	int num_cpus;
+	int num_processes;
+	char sched_policy[16];
+	int sched_preempt;
+	int fast_forward;
+	int pdes;
+	int batch;		/* Run the computing slots of a quantum at once */
+	enum engine engine;
+	int pool_threads;	/* Pool size, 0 for one per host core */
+
+	struct cpu_event cpu_plan[MAX_CPU_EVENTS];
+	int nr_cpu_events;
+	int next_cpu_event;
+	int max_cpus;		/* Most CPUs ever online */
+
+#ifdef MM_PAGING
+	int memramsz;
+	int memswpsz[PAGING_MAX_MMSWP];
+#endif
+
+	/* Arrival i in slot LD_SLOT(os, i) of ld_processes. In stream mode
+	 * the slots are reused, the config is read as the loader goes */
+	int stream;
+	struct ld_args ld_processes;
+	int ld_cap;		/* Slots in ld_processes */
+	int ld_limit;		/* Most arrivals to read */
+	int ld_read;		/* Arrivals read so far */
+	FILE * ld_file;		/* Config left to read, NULL once read */
+	pthread_mutex_t ld_file_lock;
+	int ld_next;		/* Next process to load */
+
+	/* Processes built ahead by the prefetcher, arrival i in
+	 * ld_ready[i % LD_PREFETCH], NULL if it cannot be loaded */
+	struct pcb_t * ld_ready[LD_PREFETCH];
+	int ld_built;		/* Arrivals built so far */
+	int ld_async;		/* Built by the prefetcher, not on demand */
+	pthread_t ld_prefetcher;
+	pthread_mutex_t ld_lock;
+	pthread_cond_t ld_cond;
+	int done;
+
+	struct cpu_args * cpus;
+	int cpu_shutdown;	/* Offline CPUs stop waiting to come back */
+
+	/* Parked CPUs, the last one parked on top */
+	pthread_mutex_t idle_lock;
+	int * parked;
+	int nr_parked;		/* Changed under idle_lock, read without it */
 };
 
+/* Take CPU [cpu] offline as the loader asked. Return 0 if the request
+ * was withdrawn meanwhile */
+static int cpu_go_offline(struct cpu_args * cpu) {
+	pthread_mutex_lock(&cpu->lock);
+	if (cpu->state != CPU_STOPPING) {
+		pthread_mutex_unlock(&cpu->lock);
+		return 0;
+	}
+	if (cpu->proc != NULL) {
+		sim_printf("\tCPU %d: Put process %2d to run queue\n",
+			cpu->id, cpu->proc->pid);
+		put_proc(cpu->id, cpu->proc);
+		cpu->proc = NULL;
+	}
+	cpu->dispatched = 0;
+	sched_cpu_offline(cpu->id);
+	__atomic_store_n(&cpu->state, CPU_OFFLINE, __ATOMIC_RELEASE);
+	sim_printf("\tCPU %d offline\n", cpu->id);
+	pthread_mutex_unlock(&cpu->lock);
+	return 1;
+}
+
+/* Wait until an offline CPU is brought back. Return 1 if the simulation
+ * ends first */
+static int cpu_wait_online(struct cpu_args * cpu) {
+	struct os_ctx * os = sim->os;
+	int offline;
+
+	pthread_mutex_lock(&cpu->lock);
+	while (cpu->state == CPU_OFFLINE && !os->cpu_shutdown)
+		pthread_cond_wait(&cpu->cond, &cpu->lock);
+	offline = cpu->state == CPU_OFFLINE;
+	pthread_mutex_unlock(&cpu->lock);
+	return offline;
+}
+
+/* Whether the next slot of CPU [cpu] touches no shared state: its
+ * process keeps the CPU and computes */
+static int cpu_computes_next(struct cpu_args * cpu) {
+	return cpu->dispatched && calc_run(cpu->proc) > 0;
+}
+
+/* Run CPU [cpu] for one time slot, or more in batch mode */
+static enum cpu_step cpu_step(struct cpu_args * cpu) {
+	struct os_ctx * os = sim->os;
+	int id = cpu->id;
+	struct pcb_t * proc;
+
+	/* A CPU running ahead only expected to compute. If the process
+	 * ended meanwhile, killed by another one, the queues wait until
+	 * the clock catches up */
+	if (!cpu->synced && cpu->proc != NULL &&
+			cpu->proc->pc == cpu->proc->code->size &&
+			os->engine == ENGINE_THREADS) {
+		timer_sync(cpu->timer_id);
+		cpu->synced = 1;
+	}
+
+	/* Hot-plug requests wait until the CPU is in step with the clock,
+	 * it must not touch the queues ahead of time */
+	if (cpu->synced && __atomic_load_n(&cpu->state, __ATOMIC_ACQUIRE) ==
+			CPU_STOPPING && cpu_go_offline(cpu))
+		return CPU_STEP_OFFLINE;
+
+	/* Check the status of current process */
+	proc = cpu->proc;
+
+	if (proc == NULL) {
+		/* No process is running, the we load new process from
+	 	* ready queue */
+		proc = get_proc(id);
+	}else if (proc->pc == proc->code->size) {
+		/* The porcess has finish it job */
+		sim_printf("\tCPU %d: Processed %2d has finished\n",
+			id ,proc->pid);
+		exit_proc(id, proc);
+		unload(proc);
+		proc = get_proc(id);
+		cpu->dispatched = 0;
+	}else if (!cpu->dispatched) {
+		/* The process has used up its time slice */
+		sim_printf("\tCPU %d: Put process %2d to run queue\n",
+			id, proc->pid);
+		put_proc(id, proc);
+		proc = get_proc(id);
+	}
+	cpu->proc = proc;
+
+	/* Recheck process status after loading new process */
+	if (proc == NULL && os->done) {
+		/* No process to run, exit */
+		sim_printf("\tCPU %d stopped\n", id);
+		return CPU_STEP_STOPPED;
+	}else if (proc == NULL) {
+		/* There may be new processes to run in
+		 * next time slots, just skip current slot. An idle
+		 * CPU has no event of its own, the loader brings the
+		 * next process */
+		cpu->synced = 1;
+		return CPU_STEP_IDLE;
+	}else if (!cpu->dispatched) {
+		sim_printf("\tCPU %d: Dispatched process %2d\n",
+			id, proc->pid);
+		cpu->dispatched = 1;
+	}
+
+	/* Run current process, the policy decides when its
+	 * slice is over */
+	run(proc);
+	if (sched_tick(id, proc))
+		cpu->dispatched = 0;
+	cpu->skip = 1;
+
+	/* In batch mode the slots of the slice that only compute run
+	 * right away, the CPU skips them on the clock. Each of them
+	 * still ticks, the CALC run executes at once. Without batch
+	 * mode the run is left to run(), one CALC per slot */
+	if (os->batch) {
+		uint32_t left = calc_run(proc), n = 0;
+		while (cpu->dispatched && n < left &&
+				cpu->skip < TIMER_MAX_SKIP) {
+			if (sched_tick(id, proc))
+				cpu->dispatched = 0;
+			n++;
+			cpu->skip++;
+		}
+		run_calc(proc, n);
+	}
+	cpu->resume = current_time() + cpu->skip;
+
+	/* The next slot may run ahead of the other devices if it
+	 * only computes */
+	cpu->synced = !cpu_computes_next(cpu);
+	if (cpu->skip > 1)
+		return CPU_STEP_SKIP;
+	return cpu->synced ? CPU_STEP_NEXT : CPU_STEP_AHEAD;
+}
+
+/* Bring parked CPU [cpu] back into the current slot. The caller holds
+ * idle_lock and the slot */
+static void cpu_unpark(struct cpu_args * cpu) {
+	timer_unpark(cpu->timer_id);
+	cpu->parked = 0;
+	pthread_cond_signal(&cpu->idle_cond);
+}
+
+/* Park idle CPU [cpu] until a process is queued. A parked CPU is out of
+ * the clock, so the slots go on without a round trip through it and it
+ * takes no lock until it is woken. Return 0 if it must not park, it
+ * then waits for the next slot as usual */
+static int cpu_park(struct cpu_args * cpu) {
+	struct os_ctx * os = sim->os;
+
+	pthread_mutex_lock(&os->idle_lock);
+	os->parked[os->nr_parked] = cpu->id;
+	__atomic_add_fetch(&os->nr_parked, 1, __ATOMIC_RELAXED);
+
+	/* Either the queueing side sees this CPU parked, or it sees the
+	 * process queued. Pairs with the fence in cpu_wake_idle() */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!queue_empty() || os->done ||
+			__atomic_load_n(&cpu->state, __ATOMIC_ACQUIRE) !=
+			CPU_ONLINE) {
+		__atomic_sub_fetch(&os->nr_parked, 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&os->idle_lock);
+		return 0;
+	}
+
+	cpu->parked = 1;
+	timer_park(cpu->timer_id);
+	while (cpu->parked)
+		pthread_cond_wait(&cpu->idle_cond, &os->idle_lock);
+	pthread_mutex_unlock(&os->idle_lock);
+	return 1;
+}
+
+/* Called by the scheduler once a process is queued: bring back one
+ * parked CPU to take it */
+static void cpu_wake_idle(void) {
+	struct os_ctx * os = sim->os;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&os->nr_parked, __ATOMIC_RELAXED) == 0)
+		return;
+	pthread_mutex_lock(&os->idle_lock);
+	if (os->nr_parked > 0)
+		cpu_unpark(&os->cpus[os->parked[__atomic_sub_fetch(
+			&os->nr_parked, 1, __ATOMIC_RELAXED)]]);
+	pthread_mutex_unlock(&os->idle_lock);
+}
+
+/* Bring back every parked CPU, to stop or to go offline */
+static void cpu_wake_all_idle(void) {
+	struct os_ctx * os = sim->os;
+
+	pthread_mutex_lock(&os->idle_lock);
+	while (os->nr_parked > 0)
+		cpu_unpark(&os->cpus[os->parked[__atomic_sub_fetch(
+			&os->nr_parked, 1, __ATOMIC_RELAXED)]]);
+	pthread_mutex_unlock(&os->idle_lock);
+}
 
 static void * cpu_routine(void * args) {
-	struct timer_id_t * timer_id = ((struct cpu_args*)args)->timer_id;
-	int id = ((struct cpu_args*)args)->id;
-	/* Check for new process in ready queue */
-	int time_left = 0;
-	struct pcb_t * proc = NULL;
+	struct cpu_args * cpu = (struct cpu_args*)args;
+
+	/* The hot-plug plan may bring it up meanwhile, under cpu->lock */
+	if (__atomic_load_n(&cpu->state, __ATOMIC_ACQUIRE) == CPU_OFFLINE &&
+			cpu_wait_online(cpu)) {
+		sim_printf("\tCPU %d stopped\n", cpu->id);
+		pthread_exit(NULL);
+	}
 	while (1) {
-		/* Check the status of current process */
-		if (proc == NULL) {
-			/* No process is running, the we load new process from
-		 	* ready queue */
-			proc = get_proc();
-			if (proc == NULL) {
-                           next_slot(timer_id);
-                           continue; /* First load failed. skip dummy load */
-                        }
-		}else if (proc->pc == proc->code->size) {
-			/* The porcess has finish it job */
-			printf("\tCPU %d: Processed %2d has finished\n",
-				id ,proc->pid);
-			free(proc);
-			proc = get_proc();
-			time_left = 0;
-		}else if (time_left == 0) {
-			/* The process has done its job in current time slot */
-			printf("\tCPU %d: Put process %2d to run queue\n",
-				id, proc->pid);
-			put_proc(proc);
-			proc = get_proc();
-		}
-		
-		/* Recheck process status after loading new process */
-		if (proc == NULL && done) {
-			/* No process to run, exit */
-			printf("\tCPU %d stopped\n", id);
+		switch (cpu_step(cpu)) {
+		case CPU_STEP_NEXT:
+			next_slot(cpu->timer_id);
+			break;
+		case CPU_STEP_AHEAD:
+			timer_advance(cpu->timer_id);
+			break;
+		case CPU_STEP_SKIP:
+			timer_skip(cpu->timer_id, cpu->skip);
+			break;
+		case CPU_STEP_IDLE:
+			if (!cpu_park(cpu))
+				next_slot_until(cpu->timer_id, TIMER_NEVER);
+			break;
+		case CPU_STEP_OFFLINE:
+			detach_event(cpu->timer_id);
+			if (cpu_wait_online(cpu)) {
+				sim_printf("\tCPU %d stopped\n", cpu->id);
+				pthread_exit(NULL);
+			}
 			break;
-		}else if (proc == NULL) {
-			/* There may be new processes to run in
-			 * next time slots, just skip current slot */
-			next_slot(timer_id);
+		case CPU_STEP_STOPPED:
+			detach_event(cpu->timer_id);
+			pthread_exit(NULL);
+		}
+	}
+}
+
+/* Bring the number of online CPUs to [n], the lowest offline ones come
+ * up and the highest online ones go down. The loader is attached to
+ * the clock, so a CPU it brings up takes part in the current slot */
+static void set_online_cpus(int n) {
+	struct os_ctx * os = sim->os;
+	int i;
+
+	for (i = 0; i < os->max_cpus; i++) {
+		struct cpu_args * cpu = &os->cpus[i];
+		pthread_mutex_lock(&cpu->lock);
+		if (i < n && cpu->state == CPU_STOPPING) {
+			/* It did not even leave yet */
+			__atomic_store_n(&cpu->state, CPU_ONLINE, __ATOMIC_RELEASE);
+		} else if (i < n && cpu->state == CPU_OFFLINE) {
+			cpu->timer_id = attach_event();
+			sched_cpu_online(i);
+			__atomic_store_n(&cpu->state, CPU_ONLINE, __ATOMIC_RELEASE);
+			pthread_cond_signal(&cpu->cond);
+			sim_printf("\tCPU %d online\n", i);
+		} else if (i >= n && cpu->state == CPU_ONLINE) {
+			__atomic_store_n(&cpu->state, CPU_STOPPING, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&cpu->lock);
+	}
+
+	/* Parked CPUs going down have to notice it */
+	cpu_wake_all_idle();
+}
+
+/* Apply the CPU plan events due by the current slot */
+static void run_cpu_plan(void) {
+	struct os_ctx * os = sim->os;
+
+	while (os->next_cpu_event < os->nr_cpu_events &&
+			os->cpu_plan[os->next_cpu_event].time <= current_time()) {
+		set_online_cpus(os->cpu_plan[os->next_cpu_event].nr_cpus);
+		os->next_cpu_event++;
+	}
+}
+
+static uint64_t next_cpu_event_time(void) {
+	struct os_ctx * os = sim->os;
+
+	if (os->next_cpu_event == os->nr_cpu_events)
+		return TIMER_NEVER;
+	return os->cpu_plan[os->next_cpu_event].time;
+}
+
+/* Parse the config [line] of arrival [i] into its slot. Return -1 if
+ * it holds no arrival, the slot is left alone then */
+static int read_arrival(const char * line, int i) {
+	struct os_ctx * os = sim->os;
+	struct ld_args * ld = &os->ld_processes;
+	int j = LD_SLOT(os, i);
+	unsigned long start_time, prio = 0, deadline = 0;
+	char proc[100] = {0};
+	int ret;
+
+	/* The priority is optional, policies that ignore it may
+	 * leave it out. A relative deadline may follow it and puts the
+	 * process in the earliest deadline first class */
+	ret = sscanf(line, "%lu %99s %lu %lu", &start_time, proc, &prio,
+		&deadline);
+	if (ret == EOF)
+		return -1;	/* Blank line */
+	sim_printf("[DEBUG LINE] %s", line);
+	if (ret < 2) {
+		sim_printf("Error parsing process %d line\n", i);
+		return -1;
+	}
+	sim_printf("[DEBUG] sscanf returned %d | proc = [%s] | start_time = %lu | prio = %lu\n",
+		ret, proc, start_time, prio);
+	ld->path[j] = malloc(sizeof("input/proc/") + strlen(proc));
+	sprintf(ld->path[j], "input/proc/%s", proc);
+	ld->start_time[j] = start_time;
+	ld->prio[j] = prio;
+	ld->deadline[j] = deadline;
+	sim_printf("[CONFIG] i = %d | path = %s\n", i, ld->path[j]);
+	return 0;
+}
+
+/* Read the config up to arrival [i] unless it is already read, and
+ * return the number of arrivals read so far. Arrival [i] must not be
+ * more than ld_cap ahead of ld_next, its slot may still be in use */
+static int ld_fetch(int i) {
+	struct os_ctx * os = sim->os;
+	char buffer[256];
+	int read = __atomic_load_n(&os->ld_read, __ATOMIC_ACQUIRE);
+
+	if (i < read)
+		return read;
+	pthread_mutex_lock(&os->ld_file_lock);
+	while (os->ld_read <= i && os->ld_file != NULL) {
+		if (os->ld_read < os->ld_limit &&
+				fgets(buffer, sizeof(buffer), os->ld_file)) {
+			if (read_arrival(buffer, os->ld_read) == 0)
+				__atomic_store_n(&os->ld_read, os->ld_read + 1,
+					__ATOMIC_RELEASE);
 			continue;
-		}else if (time_left == 0) {
-			printf("\tCPU %d: Dispatched process %2d\n",
-				id, proc->pid);
-			time_left = time_slot;
 		}
-		
-		/* Run current process */
-		run(proc);
-		time_left--;
-		next_slot(timer_id);
+		if (os->ld_file != stdin)
+			fclose(os->ld_file);
+		os->ld_file = NULL;
 	}
-	detach_event(timer_id);
-	pthread_exit(NULL);
+	read = os->ld_read;
+	pthread_mutex_unlock(&os->ld_file_lock);
+	return read;
+}
+
+/* Free the arrivals read and not loaded, and close the config if it
+ * is still open */
+static void ld_free(void) {
+	struct os_ctx * os = sim->os;
+	struct ld_args * ld = &os->ld_processes;
+	int i;
+
+	for (i = os->ld_next; i < os->ld_read; i++)
+		free(ld->path[LD_SLOT(os, i)]);
+	free(ld->path);
+	free(ld->start_time);
+	free(ld->prio);
+	free(ld->deadline);
+	if (os->ld_file != NULL && os->ld_file != stdin)
+		fclose(os->ld_file);
+	os->ld_file = NULL;
+}
+
+/* Build the process of arrival [i]: its code, shared with the other
+ * processes running it, and its memory */
+static struct pcb_t * ld_build(void * args, int i) {
+	struct os_ctx * os = sim->os;
+	struct pcb_t * proc = load(os->ld_processes.path[LD_SLOT(os, i)]);
+
+	if (proc == NULL)
+		return NULL;
+	proc->prio = os->ld_processes.prio[LD_SLOT(os, i)];
+#ifdef MM_PAGING
+	proc->mm = calloc(1, sizeof(struct mm_struct));
+	init_mm(proc->mm, proc);
+	proc->mram = ((struct mmpaging_ld_args *)args)->mram;
+	proc->mswp = ((struct mmpaging_ld_args *)args)->mswp;
+	proc->active_mswp = ((struct mmpaging_ld_args *)args)->active_mswp;
+#endif
+	return proc;
+}
+
+static void ld_build_task(void * args, int k) {
+	struct os_ctx * os = sim->os;
+	int i = os->ld_built + k;
+
+	os->ld_ready[i % LD_PREFETCH] = ld_build(args, i);
+}
+
+/* Build the next arrivals on a pool while the loader admits the ones
+ * built before, up to LD_PREFETCH ahead of it */
+static void * ld_prefetch_routine(void * args) {
+	struct os_ctx * os = sim->os;
+	int nr_workers = os->pool_threads;
+	struct pool * pool;
+	int n, read;
+
+	if (nr_workers <= 0)
+		nr_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_workers > LD_PREFETCH_ROUND)
+		nr_workers = LD_PREFETCH_ROUND;
+	pool = pool_create(nr_workers);
+
+	pthread_mutex_lock(&os->ld_lock);
+	for (;;) {
+		n = os->ld_next + LD_PREFETCH - os->ld_built;
+		if (n == 0) {
+			pthread_cond_wait(&os->ld_cond, &os->ld_lock);
+			continue;
+		}
+		pthread_mutex_unlock(&os->ld_lock);
+
+		/* The config may be a pipe, read it without holding up
+		 * the loader */
+		if (n > LD_PREFETCH_ROUND)
+			n = LD_PREFETCH_ROUND;
+		read = ld_fetch(os->ld_built + n - 1);
+		if (n > read - os->ld_built)
+			n = read - os->ld_built;
+		if (n > 0)
+			pool_run(pool, n, ld_build_task, args);
+
+		pthread_mutex_lock(&os->ld_lock);
+		if (n == 0)
+			break;
+		os->ld_built += n;
+		pthread_cond_broadcast(&os->ld_cond);
+	}
+	pthread_mutex_unlock(&os->ld_lock);
+	pool_destroy(pool);
+	return NULL;
+}
+
+/* Admit arrival [os->ld_next] to the run queues */
+static void ld_admit(void * args) {
+	struct os_ctx * os = sim->os;
+	int i = os->ld_next;
+	struct ld_args * ld;
+	struct pcb_t * proc;
+	int j;
+
+	if (os->ld_async) {
+		pthread_mutex_lock(&os->ld_lock);
+		while (os->ld_built <= i)
+			pthread_cond_wait(&os->ld_cond, &os->ld_lock);
+		pthread_mutex_unlock(&os->ld_lock);
+	} else {
+		os->ld_ready[i % LD_PREFETCH] = ld_build(args, i);
+		os->ld_built++;
+	}
+	proc = os->ld_ready[i % LD_PREFETCH];
+	ld = &os->ld_processes;
+	j = LD_SLOT(os, i);
+
+	if (proc == NULL) {
+		sim_printf("\tCannot load a process at %s, skipped\n",
+			ld->path[j]);
+	} else {
+		/* PIDs go in arrival order, whatever order the builds
+		 * finished in */
+		proc->pid = sim->avail_pid++;
+		sim_printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
+			ld->path[j], proc->pid, ld->prio[j]);
+		proc->deadline = 0;
+		if (ld->deadline[j]) {
+			proc->deadline = current_time() + ld->deadline[j];
+			sim_printf("\tProcess %2d must finish by time slot %lu\n",
+				proc->pid, proc->deadline);
+		}
+		add_proc(proc);
+	}
+	free(ld->path[j]);
+
+	/* Make room for the prefetcher */
+	pthread_mutex_lock(&os->ld_lock);
+	os->ld_next++;
+	pthread_cond_signal(&os->ld_cond);
+	pthread_mutex_unlock(&os->ld_lock);
+}
+
+/* Run the loader for the current time slot. Return 1 once every
+ * process is loaded and the CPU plan is over, else set [wake] to the
+ * first slot it needs to run in again */
+static int ld_step(void * args, uint64_t * wake) {
+	struct os_ctx * os = sim->os;
+	struct ld_args * ld = &os->ld_processes;
+	int cpu;
+
+	run_cpu_plan();
+
+	/* Every arrival due by now goes in together */
+	while (ld_fetch(os->ld_next) > os->ld_next &&
+			ld->start_time[LD_SLOT(os, os->ld_next)] <= current_time())
+		ld_admit(args);
+	if (ld_fetch(os->ld_next) > os->ld_next) {
+		*wake = ld->start_time[LD_SLOT(os, os->ld_next)];
+		if (next_cpu_event_time() < *wake)
+			*wake = next_cpu_event_time();
+		return 0;
+	}
+	/* CPU events after the last arrival still shape the run */
+	if (os->next_cpu_event < os->nr_cpu_events) {
+		*wake = next_cpu_event_time();
+		return 0;
+	}
+	ld_free();
+	os->done = 1;
+
+	/* CPUs left offline would wait forever */
+	for (cpu = 0; cpu < os->max_cpus; cpu++) {
+		pthread_mutex_lock(&os->cpus[cpu].lock);
+		os->cpu_shutdown = 1;
+		pthread_cond_signal(&os->cpus[cpu].cond);
+		pthread_mutex_unlock(&os->cpus[cpu].lock);
+	}
+	cpu_wake_all_idle();
+	return 1;
 }
 
 static void * ld_routine(void * args) {
 #ifdef MM_PAGING
-	struct memphy_struct* mram = ((struct mmpaging_ld_args *)args)->mram;
-	struct memphy_struct** mswp = ((struct mmpaging_ld_args *)args)->mswp;
-	struct memphy_struct* active_mswp = ((struct mmpaging_ld_args *)args)->active_mswp;
 	struct timer_id_t * timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
 #else
 	struct timer_id_t * timer_id = (struct timer_id_t*)args;
 #endif
-	int i = 0;
-	printf("ld_routine\n");
-	while (i < num_processes) {
-		struct pcb_t * proc = load(ld_processes.path[i]);
-#ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
-#endif
-		while (current_time() < ld_processes.start_time[i]) {
-			next_slot(timer_id);
-		}
-#ifdef MM_PAGING
-		proc->mm = malloc(sizeof(struct mm_struct));
-		init_mm(proc->mm, proc);
-		proc->mram = mram;
-		proc->mswp = mswp;
-		proc->active_mswp = active_mswp;
-#endif
-		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
-		add_proc(proc);
-		free(ld_processes.path[i]);
-		i++;
-		next_slot(timer_id);
-	}
-	free(ld_processes.path);
-	free(ld_processes.start_time);
-	done = 1;
+	uint64_t wake;
+
+	sim_printf("ld_routine\n");
+	while (!ld_step(args, &wake))
+		next_slot_until(timer_id, wake);
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
-static void read_config(const char *path) {
-    FILE *file = fopen(path, "r");
+/* Step the CPU [i] that takes part in the current slot */
+static void cpu_step_task(void * result, int i) {
+	struct os_ctx * os = sim->os;
+	enum cpu_step * res = result;
+
+	if (res[i] == CPU_STEP_STOPPED ||
+			__atomic_load_n(&os->cpus[i].state, __ATOMIC_ACQUIRE) ==
+			CPU_OFFLINE) {
+		if (res[i] != CPU_STEP_STOPPED)
+			res[i] = CPU_STEP_OFFLINE;
+		return;
+	}
+	/* Still in the slots it computed ahead */
+	if (res[i] == CPU_STEP_SKIP && os->cpus[i].resume > current_time())
+		return;
+	res[i] = cpu_step(&os->cpus[i]);
+}
+
+/* Run the loader and every CPU from the calling thread, slot by slot:
+ * the loader first, then the CPUs. Without [pool] the CPUs step in order
+ * on this thread. Nothing runs concurrently then, so a run is
+ * reproducible and costs no handoffs between host threads. With [pool]
+ * the CPU steps of a slot are spread over its host threads, so any
+ * number of simulated CPUs runs on as many threads as the host has
+ * cores */
+static void run_stepped(void * ld_args, struct pool * pool) {
+	struct os_ctx * os = sim->os;
+	enum cpu_step * result = malloc(sizeof(enum cpu_step) * os->max_cpus);
+	uint64_t ld_wake = 0;
+	int ld_done = 0;
+	int running, i;
+
+	for (i = 0; i < os->max_cpus; i++)
+		result[i] = CPU_STEP_NEXT;
+	sim_printf("ld_routine\n");
+	while (1) {
+		uint64_t now = current_time();
+		uint64_t next = TIMER_NEVER;
+
+		if (!ld_done && ld_wake <= now)
+			ld_done = ld_step(ld_args, &ld_wake);
+		if (!ld_done)
+			next = ld_wake > now ? ld_wake : now + 1;
+
+		if (pool != NULL) {
+			pool_run(pool, os->max_cpus, cpu_step_task, result);
+		} else {
+			for (i = 0; i < os->max_cpus; i++)
+				cpu_step_task(result, i);
+		}
+
+		running = 0;
+		for (i = 0; i < os->max_cpus; i++) {
+			switch (result[i]) {
+			case CPU_STEP_NEXT:
+			case CPU_STEP_AHEAD:
+			case CPU_STEP_SKIP:
+				/* A skipping CPU computes in each slot it skips */
+				next = now + 1;
+				running = 1;
+				break;
+			case CPU_STEP_IDLE:
+				running = 1;
+				break;
+			case CPU_STEP_OFFLINE:
+			case CPU_STEP_STOPPED:
+				break;
+			}
+		}
+		if (ld_done && !running)
+			break;
+
+		/* Skip the slots nobody needs only in fast-forward mode */
+		if (!os->fast_forward || next == TIMER_NEVER)
+			next = now + 1;
+		timer_jump(next);
+	}
+	for (i = 0; i < os->max_cpus; i++)
+		if (result[i] != CPU_STEP_STOPPED)
+			sim_printf("\tCPU %d stopped\n", i);
+	free(result);
+}
+
+/* Parse "time:cpus,time:cpus,...", return -1 if it is invalid */
+static int read_cpu_plan(const char *value) {
+    struct os_ctx *os = sim->os;
+    const char *p = value;
+    int n;
+
+    while (*p != '\0') {
+        struct cpu_event *ev = &os->cpu_plan[os->nr_cpu_events];
+        if (os->nr_cpu_events == MAX_CPU_EVENTS ||
+            sscanf(p, "%lu:%d%n", &ev->time, &ev->nr_cpus, &n) != 2 ||
+            ev->nr_cpus < 1 ||
+            (os->nr_cpu_events > 0 && ev->time < ev[-1].time)) {
+            sim_printf("Invalid cpu_plan '%s'\n", value);
+            return -1;
+        }
+        os->nr_cpu_events++;
+        p += n;
+        if (*p == ',')
+            p++;
+    }
+    return 0;
+}
+
+/* The system parameter line may carry "key=value" options after
+ * time_slot, num_cpus and num_processes, e.g. "2 4 8 sched=mlfq".
+ * Return -1 on an invalid option */
+static int read_options(char *line) {
+    struct os_ctx *os = sim->os;
+    /* Configs of a batch are read on several threads at once */
+    char *save;
+    char *tok = strtok_r(line, " \t\r\n", &save);
+    int field;
+
+    for (field = 0; tok != NULL; tok = strtok_r(NULL, " \t\r\n", &save), field++) {
+        if (field < 3)
+            continue;
+        char *value = strchr(tok, '=');
+        if (value == NULL) {
+            sim_printf("Invalid option '%s', expected key=value\n", tok);
+            return -1;
+        }
+        *value++ = '\0';
+        if (!strcmp(tok, "sched")) {
+            snprintf(os->sched_policy, sizeof(os->sched_policy), "%s", value);
+        } else if (!strcmp(tok, "preempt")) {
+            os->sched_preempt = atoi(value);
+        } else if (!strcmp(tok, "fast_forward")) {
+            os->fast_forward = atoi(value);
+        } else if (!strcmp(tok, "pdes")) {
+            os->pdes = atoi(value);
+        } else if (!strcmp(tok, "batch")) {
+            os->batch = atoi(value);
+        } else if (!strcmp(tok, "stream")) {
+            os->stream = atoi(value);
+        } else if (!strcmp(tok, "engine")) {
+            if (!strcmp(value, "single")) {
+                os->engine = ENGINE_SINGLE;
+            } else if (!strcmp(value, "threads")) {
+                os->engine = ENGINE_THREADS;
+            } else if (!strcmp(value, "pool")) {
+                os->engine = ENGINE_POOL;
+            } else {
+                sim_printf("Unknown engine '%s'\n", value);
+                return -1;
+            }
+        } else if (!strcmp(tok, "pool_threads")) {
+            os->pool_threads = atoi(value);
+        } else if (!strcmp(tok, "cpu_plan")) {
+            if (read_cpu_plan(value) != 0)
+                return -1;
+        } else {
+            sim_printf("Unknown option '%s'\n", tok);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Read the config at [path], "-" for stdin. In stream mode only its
+ * header is read here, the arrivals as the loader needs them. Return
+ * -1 on an invalid config, nothing read from it is kept then */
+static int read_config(const char *path) {
+    struct os_ctx *os = sim->os;
+    FILE *file = strcmp(path, "-") ? fopen(path, "r") : stdin;
     if (!file) {
-        printf("Cannot find configure file at %s\n", path);
-        exit(1);
+        sim_printf("Cannot find configure file at %s\n", path);
+        return -1;
     }
+    os->ld_file = file;
 
     char buffer[256];
 
     // Đọc dòng đầu tiên: time_slot, num_cpus, num_processes
     if (!fgets(buffer, sizeof(buffer), file) ||
-        sscanf(buffer, "%d %d %d", &time_slot, &num_cpus, &num_processes) != 3) {
-        printf("Invalid format for system parameters\n");
-        fclose(file);
-        exit(1);
+        sscanf(buffer, "%d %d %d", &os->time_slot, &os->num_cpus, &os->num_processes) != 3) {
+        sim_printf("Invalid format for system parameters\n");
+        ld_free();
+        return -1;
+    }
+    sim_printf("[DEBUG] Read time_slot = %d | num_cpus = %d | num_processes = %d\n", os->time_slot, os->num_cpus, os->num_processes);
+    if (read_options(buffer) != 0) {
+        ld_free();
+        return -1;
     }
-    printf("[DEBUG] Read time_slot = %d | num_cpus = %d | num_processes = %d\n", time_slot, num_cpus, num_processes);
 
     // Cấp phát bộ nhớ cho process
-    ld_processes.path = malloc(sizeof(char*) * num_processes);
-    ld_processes.start_time = malloc(sizeof(unsigned long) * num_processes);
+    /* In stream mode num_processes bounds the arrivals, 0 reads
+     * them up to the end of the config */
+    os->ld_limit = os->num_processes;
+    os->ld_cap = os->num_processes;
+    if (os->stream) {
+        if (os->ld_limit == 0)
+            os->ld_limit = INT_MAX;
+        os->ld_cap = LD_PREFETCH;
+    }
+    os->ld_processes.path = malloc(sizeof(char*) * os->ld_cap);
+    os->ld_processes.start_time = malloc(sizeof(unsigned long) * os->ld_cap);
+    os->ld_processes.prio = malloc(sizeof(unsigned long) * os->ld_cap);
+    os->ld_processes.deadline = malloc(sizeof(unsigned long) * os->ld_cap);
+    os->ld_read = 0;
 
 #ifdef MM_PAGING
     // Kiểm tra dòng tiếp theo có phải cấu hình bộ nhớ hay không
-    long pos = ftell(file);
+    /* A pipe cannot seek back, a line that is not the memory config
+     * is the first arrival */
     if (fgets(buffer, sizeof(buffer), file)) {
         int is_mem_config = 1;
         for (int i = 0; buffer[i]; i++) {
@@ -174,89 +904,118 @@ static void read_config(const char *path) {
                 break;
             }
         }
-        fseek(file, pos, SEEK_SET); // quay lại vị trí cũ
 
         if (is_mem_config) {
-            fscanf(file, "%d", &memramsz);
+            char *p = buffer;
+            int n;
+            sscanf(p, "%d%n", &os->memramsz, &n);
             for (int i = 0; i < PAGING_MAX_MMSWP; i++) {
-                fscanf(file, "%d", &memswpsz[i]);
+                p += n;
+                n = 0;
+                sscanf(p, "%d%n", &os->memswpsz[i], &n);
             }
-            fgetc(file); // đọc ký tự newline
+        } else if (os->ld_limit > 0 && read_arrival(buffer, 0) == 0) {
+            os->ld_read = 1;
         }
     } else {
-        printf("Unexpected EOF when checking memory config\n");
-        fclose(file);
-        exit(1);
+        sim_printf("Unexpected EOF when checking memory config\n");
+        ld_free();
+        return -1;
     }
 #endif
 
-#ifdef MLQ_SCHED
-    ld_processes.prio = malloc(sizeof(unsigned long) * num_processes);
-#endif
+    if (os->stream)
+        return 0;
 
     // Đọc cấu hình các process
-    for (int i = 0; i < num_processes; i++) {
+    /* Lines without an arrival do not count */
+    while (os->ld_read < os->num_processes) {
         if (!fgets(buffer, sizeof(buffer), file)) {
-            printf("Error reading process %d configuration\n", i);
-            fclose(file);
-            exit(1);
-        }
-        printf("[DEBUG LINE] %s", buffer);
-
-        char proc[100] = {0};
-        ld_processes.path[i] = malloc(100);
-        strcpy(ld_processes.path[i], "input/proc/");
-
-#ifdef MLQ_SCHED
-        int ret = sscanf(buffer, "%lu %s %lu", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
-        if (ret != 3) {
-            printf("Error parsing process %d line\n", i);
-            continue;
-        }
-        printf("[DEBUG] sscanf returned %d | proc = [%s] | start_time = %lu | prio = %lu\n",
-               ret, proc, ld_processes.start_time[i], ld_processes.prio[i]);
-#else
-        int ret = sscanf(buffer, "%lu %s", &ld_processes.start_time[i], proc);
-        if (ret != 2) {
-            printf("Error parsing process %d line\n", i);
-            continue;
+            sim_printf("Error reading process %d configuration\n", os->ld_read);
+            ld_free();
+            return -1;
         }
-        printf("[DEBUG] sscanf returned %d | proc = [%s] | start_time = %lu\n",
-               ret, proc, ld_processes.start_time[i]);
-#endif
-        strcat(ld_processes.path[i], proc);
-        printf("[CONFIG] i = %d | path = %s\n", i, ld_processes.path[i]);
+        if (read_arrival(buffer, os->ld_read) == 0)
+            os->ld_read++;
     }
 
-    fclose(file);
+    if (file != stdin)
+        fclose(file);
+    os->ld_file = NULL;
+    return 0;
 }
 
+/* Run the config input/[name], or stdin for "-", as the current
+ * simulation */
+static int run_config(const char * name) {
+	struct os_ctx * os = calloc(1, sizeof(struct os_ctx));
+	char path[100];
 
+	sim->os = os;
+	snprintf(os->sched_policy, sizeof(os->sched_policy), "%s",
+		SCHED_DEFAULT_POLICY);
+	if (!strcmp(name, "-"))
+		snprintf(path, sizeof(path), "-");
+	else
+		snprintf(path, sizeof(path), "input/%s", name);
+	if (read_config(path) != 0) {
+		free(os);
+		sim->os = NULL;
+		return 1;
+	}
 
-int main(int argc, char * argv[]) {
-	/* Read config */
-	if (argc != 2) {
-		printf("Usage: os [path to configure file]\n");
+	/* The CPU plan may bring up more CPUs than the system starts
+	 * with, they all get a thread which waits while offline */
+	int i;
+	os->max_cpus = os->num_cpus;
+	for (i = 0; i < os->nr_cpu_events; i++)
+		if (os->cpu_plan[i].nr_cpus > os->max_cpus)
+			os->max_cpus = os->cpu_plan[i].nr_cpus;
+
+	/* Init scheduler, before anything else is set up that a wrong
+	 * policy would have to undo */
+	if (init_scheduler(os->max_cpus, os->time_slot, os->sched_policy,
+			os->sched_preempt) != 0) {
+		sim_printf("Unknown scheduling policy '%s'\n", os->sched_policy);
+		ld_free();
+		free(os);
+		sim->os = NULL;
 		return 1;
 	}
-	char path[100];
-	path[0] = '\0';
-	strcat(path, "input/");
-	strcat(path, argv[1]);
-	read_config(path);
-
-	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
-	struct cpu_args * args =
-		(struct cpu_args*)malloc(sizeof(struct cpu_args) * num_cpus);
+	for (i = os->num_cpus; i < os->max_cpus; i++)
+		sched_cpu_offline(i);
+
+	pthread_t * cpu = (pthread_t*)malloc(os->max_cpus * sizeof(pthread_t));
+	os->cpus = (struct cpu_args*)malloc(sizeof(struct cpu_args) * os->max_cpus);
 	pthread_t ld;
 	
+	/* With preemption a slice may end in any slot, from another CPU,
+	 * so no CPU may run ahead of the others either */
+	if (os->sched_preempt) {
+		os->batch = 0;
+		os->pdes = 0;
+	}
+
 	/* Init timer */
-	int i;
-	for (i = 0; i < num_cpus; i++) {
-		args[i].timer_id = attach_event();
-		args[i].id = i;
+	init_timer();
+	for (i = 0; i < os->max_cpus; i++) {
+		os->cpus[i].timer_id = i < os->num_cpus ? attach_event() : NULL;
+		os->cpus[i].id = i;
+		os->cpus[i].proc = NULL;
+		os->cpus[i].dispatched = 0;
+		os->cpus[i].synced = 1;
+		os->cpus[i].state = i < os->num_cpus ? CPU_ONLINE : CPU_OFFLINE;
+		pthread_mutex_init(&os->cpus[i].lock, NULL);
+		pthread_cond_init(&os->cpus[i].cond, NULL);
+		os->cpus[i].parked = 0;
+		pthread_cond_init(&os->cpus[i].idle_cond, NULL);
 	}
+	os->parked = (int*)malloc(sizeof(int) * os->max_cpus);
+	os->nr_parked = 0;
+	pthread_mutex_init(&os->idle_lock, NULL);
 	struct timer_id_t * ld_event = attach_event();
+	timer_fast_forward(os->fast_forward);
+	timer_pdes(os->pdes);
 	start_timer();
 
 #ifdef MM_PAGING
@@ -267,12 +1026,12 @@ int main(int argc, char * argv[]) {
 	struct memphy_struct mswp[PAGING_MAX_MMSWP];
 
 	/* Create MEM RAM */
-	init_memphy(&mram, memramsz, rdmflag);
+	init_memphy(&mram, os->memramsz, rdmflag);
 
         /* Create all MEM SWAP */ 
 	int sit;
 	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-	       init_memphy(&mswp[sit], memswpsz[sit], rdmflag);
+	       init_memphy(&mswp[sit], os->memswpsz[sit], rdmflag);
 
 	/* In Paging mode, it needs passing the system mem to each PCB through loader*/
 	struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
@@ -284,32 +1043,164 @@ int main(int argc, char * argv[]) {
         mm_ld_args->active_mswp_id = 0;
 #endif
 
-	/* Init scheduler */
-	init_scheduler();
-
 	/* Run CPU and loader */
 #ifdef MM_PAGING
-	pthread_create(&ld, NULL, ld_routine, (void*)mm_ld_args);
+	void * ld_args = mm_ld_args;
 #else
-	pthread_create(&ld, NULL, ld_routine, (void*)ld_event);
+	void * ld_args = ld_event;
 #endif
-	for (i = 0; i < num_cpus; i++) {
-		pthread_create(&cpu[i], NULL,
-			cpu_routine, (void*)&args[i]);
-	}
 
-	/* Wait for CPU and loader finishing */
-	for (i = 0; i < num_cpus; i++) {
-		pthread_join(cpu[i], NULL);
+	/* Arrivals are built ahead of time, but on demand for the single
+	 * engine, which runs nothing concurrently */
+	os->ld_built = 0;
+	os->ld_async = os->engine != ENGINE_SINGLE;
+	pthread_mutex_init(&os->ld_lock, NULL);
+	pthread_cond_init(&os->ld_cond, NULL);
+	pthread_mutex_init(&os->ld_file_lock, NULL);
+	if (os->ld_async)
+		sim_thread_create(&os->ld_prefetcher, ld_prefetch_routine,
+			ld_args);
+	if (os->engine == ENGINE_SINGLE) {
+		sched_set_threaded(0);
+		run_stepped(ld_args, NULL);
+	} else if (os->engine == ENGINE_POOL) {
+		int nr_workers = os->pool_threads;
+		if (nr_workers <= 0)
+			nr_workers = sysconf(_SC_NPROCESSORS_ONLN);
+		if (nr_workers > os->max_cpus)
+			nr_workers = os->max_cpus;
+		struct pool * pool = pool_create(nr_workers);
+		run_stepped(ld_args, pool);
+		pool_destroy(pool);
+	} else {
+		/* Idle CPUs park until a process is queued */
+		sched_set_wake(cpu_wake_idle);
+		sim_thread_create(&ld, ld_routine, ld_args);
+		for (i = 0; i < os->max_cpus; i++) {
+			sim_thread_create(&cpu[i],
+				cpu_routine, (void*)&os->cpus[i]);
+		}
+
+		/* Wait for CPU and loader finishing */
+		for (i = 0; i < os->max_cpus; i++) {
+			pthread_join(cpu[i], NULL);
+		}
+		pthread_join(ld, NULL);
 	}
-	pthread_join(ld, NULL);
+
+	if (os->ld_async)
+		pthread_join(os->ld_prefetcher, NULL);
+	pthread_mutex_destroy(&os->ld_lock);
+	pthread_cond_destroy(&os->ld_cond);
+	pthread_mutex_destroy(&os->ld_file_lock);
 
 	/* Stop timer */
 	stop_timer();
+	finish_scheduler();
 
+	for (i = 0; i < os->max_cpus; i++) {
+		pthread_mutex_destroy(&os->cpus[i].lock);
+		pthread_cond_destroy(&os->cpus[i].cond);
+		pthread_cond_destroy(&os->cpus[i].idle_cond);
+	}
+	pthread_mutex_destroy(&os->idle_lock);
+	free(os->parked);
+	free(os->cpus);
+	free(cpu);
+#ifdef MM_PAGING
+	free(mm_ld_args);
+#endif
+	free(os);
+	sim->os = NULL;
 	return 0;
+}
+
+/* Configs run side by side, each as its own simulation */
+struct batch {
+	char ** configs;
+	const char * out_dir;
+	int failed;
+};
+
+/* Run config [i] of the batch, its trace goes to
+ * <out_dir>/<config>.output */
+static void batch_task(void * arg, int i) {
+	struct batch * batch = arg;
+	const char * name = batch->configs[i];
+	char path[256];
+	char * c;
+	FILE * out;
+
+	snprintf(path, sizeof(path), "%s/%s.output", batch->out_dir, name);
+	for (c = path + strlen(batch->out_dir) + 1; *c != '\0'; c++)
+		if (*c == '/')
+			*c = '_';
+	if ((out = fopen(path, "w")) == NULL) {
+		printf("Cannot write the output of %s to %s\n", name, path);
+		__atomic_add_fetch(&batch->failed, 1, __ATOMIC_RELAXED);
+		return;
+	}
 
+	sim = sim_create(out);
+	if (run_config(name) != 0)
+		__atomic_add_fetch(&batch->failed, 1, __ATOMIC_RELAXED);
+	sim_destroy(sim);
+	sim = NULL;
+	fclose(out);
+	printf("%s: %s\n", name, path);
 }
 
+/* Run [n] configs, up to [jobs] at once */
+static int run_batch(char ** configs, int n, int jobs,
+		const char * out_dir) {
+	struct batch batch = { configs, out_dir, 0 };
+	struct pool * pool;
+
+	if (jobs <= 0)
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs > n)
+		jobs = n;
+	mkdir(out_dir, 0755);
+	pool = pool_create(jobs);
+	pool_run(pool, n, batch_task, &batch);
+	pool_destroy(pool);
+	return batch.failed != 0;
+}
 
+/* "os config" runs one config and prints its trace. Several configs,
+ * or an output directory, make a batch: the configs run in parallel,
+ * [jobs] at a time, each writing its trace to <dir>/<config>.output */
+int main(int argc, char * argv[]) {
+	const char * out_dir = NULL;
+	int jobs = 0;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "j:o:")) != -1) {
+		switch (opt) {
+		case 'j':
+			jobs = atoi(optarg);
+			break;
+		case 'o':
+			out_dir = optarg;
+			break;
+		default:
+			optind = argc + 1;
+			break;
+		}
+	}
+	if (optind >= argc) {
+		printf("Usage: os [-j jobs] [-o output dir] "
+			"[path to configure file]...\n");
+		return 1;
+	}
 
+	if (optind + 1 == argc && out_dir == NULL) {
+		sim = sim_create(stdout);
+		ret = run_config(argv[optind]);
+		sim_destroy(sim);
+		return ret;
+	}
+	if (out_dir == NULL)
+		out_dir = BATCH_OUTPUT_DIR;
+	return run_batch(&argv[optind], argc - optind, jobs, out_dir);
+}
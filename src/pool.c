@@ -0,0 +1,200 @@
+/*
+ * Work-stealing thread pool
+ * A batch of n tasks is cut into one contiguous slice per worker. The
+ * owner takes tasks from the bottom of its slice, a worker whose slice
+ * is empty steals from the top of another one. Slice bounds are packed
+ * in one word so that both ends move with a single compare-and-swap.
+ */
+
+#include "pool.h"
+#include "sim.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* From the system <sched.h>, which include/sched.h shadows */
+int sched_yield(void);
+
+/* Polls of the batch state before a worker parks */
+#define POOL_SPIN		1000
+
+#define SLICE(lo, hi)		(((uint64_t)(hi) << 32) | (uint32_t)(lo))
+#define SLICE_LO(s)		((int)(uint32_t)(s))
+#define SLICE_HI(s)		((int)((s) >> 32))
+
+struct pool_worker {
+	pthread_t thread;
+	struct pool * pool;
+	int id;
+	uint64_t slice;		/* Tasks left, SLICE(lo, hi) */
+} __attribute__((aligned(64)));
+
+struct pool {
+	int nr_workers;
+	struct pool_worker * workers;
+
+	/* Current batch */
+	void (*fn)(void *, int);
+	void * arg;
+	unsigned long batch;	/* Bumped to start a batch */
+	int busy;		/* Workers still in the batch */
+	int stop;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start_cond;
+	pthread_cond_t done_cond;
+};
+
+/* Take the next task of [w]'s own slice, -1 if it is empty */
+static int slice_pop(struct pool_worker * w) {
+	uint64_t s = __atomic_load_n(&w->slice, __ATOMIC_ACQUIRE);
+
+	while (SLICE_LO(s) < SLICE_HI(s)) {
+		if (__atomic_compare_exchange_n(&w->slice, &s,
+				SLICE(SLICE_LO(s) + 1, SLICE_HI(s)), 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			return SLICE_LO(s);
+	}
+	return -1;
+}
+
+/* Take the last task of [victim]'s slice, -1 if it is empty */
+static int slice_steal(struct pool_worker * victim) {
+	uint64_t s = __atomic_load_n(&victim->slice, __ATOMIC_ACQUIRE);
+
+	while (SLICE_LO(s) < SLICE_HI(s)) {
+		if (__atomic_compare_exchange_n(&victim->slice, &s,
+				SLICE(SLICE_LO(s), SLICE_HI(s) - 1), 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			return SLICE_HI(s) - 1;
+	}
+	return -1;
+}
+
+/* Run tasks of the current batch until none is left anywhere */
+static void pool_work(struct pool_worker * w) {
+	struct pool * pool = w->pool;
+	int i, task;
+
+	while ((task = slice_pop(w)) >= 0)
+		pool->fn(pool->arg, task);
+	for (i = 1; i < pool->nr_workers; i++) {
+		struct pool_worker * victim =
+			&pool->workers[(w->id + i) % pool->nr_workers];
+		while ((task = slice_steal(victim)) >= 0)
+			pool->fn(pool->arg, task);
+	}
+
+	if (__atomic_sub_fetch(&pool->busy, 1, __ATOMIC_ACQ_REL) == 0) {
+		pthread_mutex_lock(&pool->lock);
+		pthread_cond_signal(&pool->done_cond);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+static void * pool_routine(void * args) {
+	struct pool_worker * w = (struct pool_worker *)args;
+	struct pool * pool = w->pool;
+	unsigned long seen = 0;
+	int i;
+
+	while (1) {
+		/* Wait for the next batch */
+		for (i = 0; i < POOL_SPIN; i++) {
+			if (__atomic_load_n(&pool->batch, __ATOMIC_ACQUIRE) != seen)
+				break;
+			sched_yield();
+		}
+		pthread_mutex_lock(&pool->lock);
+		while (__atomic_load_n(&pool->batch, __ATOMIC_ACQUIRE) == seen &&
+				!pool->stop)
+			pthread_cond_wait(&pool->start_cond, &pool->lock);
+		pthread_mutex_unlock(&pool->lock);
+		if (pool->stop)
+			break;
+		seen = __atomic_load_n(&pool->batch, __ATOMIC_ACQUIRE);
+		pool_work(w);
+	}
+	return NULL;
+}
+
+struct pool * pool_create(int nr_workers) {
+	struct pool * pool = calloc(1, sizeof(struct pool));
+	int i;
+
+	if (nr_workers < 1)
+		nr_workers = 1;
+	pool->nr_workers = nr_workers;
+	pool->workers = aligned_alloc(64,
+			sizeof(struct pool_worker) * nr_workers);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+	for (i = 0; i < nr_workers; i++) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].id = i;
+		pool->workers[i].slice = SLICE(0, 0);
+	}
+
+	/* Worker 0 is the thread calling pool_run(). The others work for
+	 * the same simulation as the thread creating the pool */
+	for (i = 1; i < nr_workers; i++) {
+		if (sim_thread_create(&pool->workers[i].thread,
+				pool_routine, &pool->workers[i]) != 0) {
+			printf("Cannot start pool worker %d\n", i);
+			exit(1);
+		}
+	}
+	return pool;
+}
+
+void pool_run(struct pool * pool, int n, void (*fn)(void *, int), void * arg) {
+	int i;
+
+	pool->fn = fn;
+	pool->arg = arg;
+	for (i = 0; i < pool->nr_workers; i++)
+		__atomic_store_n(&pool->workers[i].slice,
+			SLICE((long)n * i / pool->nr_workers,
+				(long)n * (i + 1) / pool->nr_workers),
+			__ATOMIC_RELAXED);
+	__atomic_store_n(&pool->busy, pool->nr_workers, __ATOMIC_RELAXED);
+
+	/* Start the batch */
+	pthread_mutex_lock(&pool->lock);
+	__atomic_add_fetch(&pool->batch, 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&pool->start_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	pool_work(&pool->workers[0]);
+
+	/* Wait for the stragglers */
+	for (i = 0; i < POOL_SPIN; i++) {
+		if (__atomic_load_n(&pool->busy, __ATOMIC_ACQUIRE) == 0)
+			return;
+		sched_yield();
+	}
+	pthread_mutex_lock(&pool->lock);
+	while (__atomic_load_n(&pool->busy, __ATOMIC_ACQUIRE) != 0)
+		pthread_cond_wait(&pool->done_cond, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(struct pool * pool) {
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->start_cond);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 1; i < pool->nr_workers; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->start_cond);
+	pthread_cond_destroy(&pool->done_cond);
+	free(pool->workers);
+	free(pool);
+}
+
@@ -0,0 +1,158 @@
+
+#include "prog.h"
+#include "sim.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define OPT_CALC	"calc"
+#define OPT_ALLOC	"alloc"
+#define OPT_FREE	"free"
+#define OPT_READ	"read"
+#define OPT_WRITE	"write"
+#define OPT_SYSCALL	"syscall"
+
+/* The records are used in place, their layout is the format */
+_Static_assert(sizeof(struct inst_t) == 5 * sizeof(uint32_t),
+	"struct inst_t is not packed");
+
+static int get_opcode(char * opt) {
+	if (!strcmp(opt, OPT_CALC)) {
+		return CALC;
+	}else if (!strcmp(opt, OPT_ALLOC)) {
+		return ALLOC;
+	}else if (!strcmp(opt, OPT_FREE)) {
+		return FREE;
+	}else if (!strcmp(opt, OPT_READ)) {
+		return READ;
+	}else if (!strcmp(opt, OPT_WRITE)) {
+		return WRITE;
+	}else if (!strcmp(opt, OPT_SYSCALL)) {
+		return SYSCALL;
+	}else{
+		return -1;
+	}
+}
+
+int prog_parse(FILE * file, uint32_t * priority, struct code_seg_t * code) {
+	char opcode[10];
+	char buf[200];
+	uint32_t i;
+	int op;
+
+	code->map = NULL;
+	code->text = NULL;
+	if (fscanf(file, "%u %u", priority, &code->size) != 2) {
+		sim_printf("Invalid program header\n");
+		return -1;
+	}
+	code->text = (struct inst_t*)malloc(
+		sizeof(struct inst_t) * code->size
+	);
+	for (i = 0; i < code->size; i++) {
+		struct inst_t * ins = &code->text[i];
+		if (fscanf(file, "%9s", opcode) != 1 ||
+				(op = get_opcode(opcode)) < 0) {
+			sim_printf("Invalid opcode at instruction %u\n", i);
+			free(code->text);
+			code->text = NULL;
+			return -1;
+		}
+		ins->opcode = op;
+		switch(ins->opcode) {
+		case CALC:
+			break;
+		case ALLOC:
+			fscanf(file, "%u %u\n", &ins->arg_0, &ins->arg_1);
+			break;
+		case FREE:
+			fscanf(file, "%u\n", &ins->arg_0);
+			break;
+		case READ:
+		case WRITE:
+			fscanf(file, "%u %u %u\n",
+				&ins->arg_0, &ins->arg_1, &ins->arg_2);
+			break;
+		case SYSCALL:
+			fgets(buf, sizeof(buf), file);
+			sscanf(buf, "%d%d%d%d",
+				&ins->arg_0, &ins->arg_1,
+				&ins->arg_2, &ins->arg_3);
+			break;
+		}
+	}
+	return 0;
+}
+
+int prog_map(const char * path, uint32_t * priority, struct code_seg_t * code) {
+	struct prog_header * hdr;
+	struct stat st;
+	void * map;
+	uint32_t i;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return 1;
+	if (fstat(fd, &st) != 0 || st.st_size < sizeof(struct prog_header)) {
+		close(fd);
+		return 1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 1;
+	hdr = map;
+	if (hdr->magic != PROG_MAGIC) {
+		munmap(map, st.st_size);
+		return 1;
+	}
+
+	code->map = map;
+	code->map_size = st.st_size;
+	code->text = (struct inst_t *)(hdr + 1);
+	code->size = hdr->size;
+	*priority = hdr->priority;
+	if (hdr->version != PROG_VERSION ||
+			(st.st_size - sizeof(struct prog_header)) /
+			sizeof(struct inst_t) < hdr->size) {
+		sim_printf("Broken compiled program '%s'\n", path);
+		prog_release(code);
+		return -1;
+	}
+	for (i = 0; i < code->size; i++) {
+		if (code->text[i].opcode > SYSCALL) {
+			sim_printf("Invalid opcode at instruction %u\n", i);
+			prog_release(code);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void prog_release(struct code_seg_t * code) {
+	if (code->map != NULL)
+		munmap(code->map, code->map_size);
+	else
+		free(code->text);
+	code->map = NULL;
+	code->text = NULL;
+}
+
+int prog_write(FILE * file, uint32_t priority, const struct code_seg_t * code) {
+	struct prog_header hdr = {
+		.magic = PROG_MAGIC,
+		.version = PROG_VERSION,
+		.priority = priority,
+		.size = code->size,
+	};
+
+	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1 ||
+			fwrite(code->text, sizeof(struct inst_t), code->size,
+				file) != code->size)
+		return -1;
+	return 0;
+}
+
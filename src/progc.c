@@ -0,0 +1,42 @@
+/*
+ * Program compiler
+ * Turns programs in the text form of input/proc into compiled ones,
+ * which the loader maps instead of parsing them:
+ *	progc <program> <compiled program>
+ */
+
+#include "prog.h"
+#include <stdio.h>
+
+int main(int argc, char * argv[]) {
+	struct code_seg_t code;
+	uint32_t priority;
+	FILE * in, * out;
+
+	if (argc != 3) {
+		printf("Usage: %s <program> <compiled program>\n", argv[0]);
+		return 1;
+	}
+	if ((in = fopen(argv[1], "r")) == NULL) {
+		printf("Cannot find program at '%s'\n", argv[1]);
+		return 1;
+	}
+	if (prog_parse(in, &priority, &code) != 0) {
+		printf("Cannot compile '%s'\n", argv[1]);
+		fclose(in);
+		return 1;
+	}
+	fclose(in);
+
+	if ((out = fopen(argv[2], "wb")) == NULL) {
+		printf("Cannot create '%s'\n", argv[2]);
+		return 1;
+	}
+	if (prog_write(out, priority, &code) != 0 || fclose(out) != 0) {
+		printf("Cannot write '%s'\n", argv[2]);
+		return 1;
+	}
+	prog_release(&code);
+	return 0;
+}
+
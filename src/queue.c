@@ -1,42 +1,72 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "queue.h"
+#include "sim.h"
 
 int empty(struct queue_t * q) {
         if (q == NULL) return 1;
 	return (q->size == 0);
 }
 
+/* Double the capacity of [q], unwrapping the ring so that the oldest
+ * process lands in slot 0 */
+static void queue_grow(struct queue_t * q) {
+        int capacity = q->capacity ? 2 * q->capacity : QUEUE_INIT_CAPACITY;
+        struct pcb_t ** proc = malloc(sizeof(struct pcb_t *) * capacity);
+        int i;
+
+        if (proc == NULL) {
+                sim_printf("Cannot grow queue to %d processes\n", capacity);
+                exit(1);
+        }
+        for (i = 0; i < q->size; i++)
+                proc[i] = q->proc[(q->head + i) % q->capacity];
+        free(q->proc);
+        q->proc = proc;
+        q->head = 0;
+        q->capacity = capacity;
+}
+
 void enqueue(struct queue_t * q, struct pcb_t * proc) {
-        /* TODO: put a new process to queue [q] */
-        if(q->size == MAX_QUEUE_SIZE || q==NULL) return;
-    //    printf("Enqueue PID: %d to prio %d queue, size before: %d\n", proc->pid, proc->prio, q->size);
-        //if(empty(q))q = malloc(sizeof(struct queue_t));
-        q->proc[q->size++] = proc;
+        if (q == NULL) return;
+        if (q->size == q->capacity)
+                queue_grow(q);
+        q->proc[(q->head + q->size) % q->capacity] = proc;
+        q->size++;
 }
 
 struct pcb_t * dequeue(struct queue_t * q) {
-        /* TODO: return a pcb whose prioprity is the highest
-         * in the queue [q] and remember to remove it from q
-         * */
+        /* Every process of a queue shares one priority level, so the
+         * oldest one is the next to run */
         if(empty(q)) return NULL ;
 
-        struct pcb_t* highest_prio = q->proc[0];
-        int index = 0;
+        struct pcb_t * proc = q->proc[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->size--;
+        return proc;
+}
 
-        for( int i = 0; i<q->size; i++){
-             if(q->proc[i]->prio > highest_prio->prio){
-                 highest_prio = q->proc[i];
-                 index = i;
-             }
-        }
+struct pcb_t * queue_at(struct queue_t * q, int i) {
+        return q->proc[(q->head + i) % q->capacity];
+}
 
-        for(int j=index; j < q->size - 1;j++){
-               q->proc[j] = q->proc[j+1]; 
-        }
+struct pcb_t * queue_remove(struct queue_t * q, int i) {
+        struct pcb_t * proc = queue_at(q, i);
+
+        /* Shift the processes ahead of it back into the hole */
+        for (; i > 0; i--)
+                q->proc[(q->head + i) % q->capacity] =
+                        q->proc[(q->head + i - 1) % q->capacity];
+        q->head = (q->head + 1) % q->capacity;
         q->size--;
-        return highest_prio;
+        return proc;
+}
 
-    
+void queue_free(struct queue_t * q) {
+        free(q->proc);
+        q->proc = NULL;
+        q->head = 0;
+        q->size = 0;
+        q->capacity = 0;
 }
 
@@ -0,0 +1,221 @@
+/*
+ * Red-black tree
+ * Leaves are NULL and count as black.
+ */
+
+#include "rbtree.h"
+
+static int is_red(struct rb_node * node) {
+	return node != NULL && node->red;
+}
+
+/* Put [new] where [old] hangs below [parent] */
+static void change_child(struct rb_root * root, struct rb_node * parent,
+		struct rb_node * old, struct rb_node * new) {
+	if (parent == NULL)
+		root->node = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+}
+
+static void rotate_left(struct rb_root * root, struct rb_node * x) {
+	struct rb_node * y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+	y->parent = x->parent;
+	change_child(root, x->parent, x, y);
+	y->left = x;
+	x->parent = y;
+}
+
+static void rotate_right(struct rb_root * root, struct rb_node * x) {
+	struct rb_node * y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+	y->parent = x->parent;
+	change_child(root, x->parent, x, y);
+	y->right = x;
+	x->parent = y;
+}
+
+void rb_insert(struct rb_root * root, struct rb_node * node, rb_less_t less) {
+	struct rb_node ** link = &root->node;
+	struct rb_node * parent = NULL;
+	int leftmost = 1;
+
+	while (*link != NULL) {
+		parent = *link;
+		if (less(node, parent)) {
+			link = &parent->left;
+		} else {
+			link = &parent->right;
+			leftmost = 0;
+		}
+	}
+	node->parent = parent;
+	node->left = node->right = NULL;
+	node->red = 1;
+	*link = node;
+	if (leftmost)
+		root->leftmost = node;
+
+	/* Restore the red-black properties going up */
+	while (is_red(node->parent)) {
+		struct rb_node * p = node->parent;
+		struct rb_node * g = p->parent;
+		struct rb_node * uncle = (p == g->left) ? g->right : g->left;
+
+		if (is_red(uncle)) {
+			p->red = 0;
+			uncle->red = 0;
+			g->red = 1;
+			node = g;
+			continue;
+		}
+		if (p == g->left) {
+			if (node == p->right) {
+				rotate_left(root, p);
+				node = p;
+				p = node->parent;
+			}
+			rotate_right(root, g);
+		} else {
+			if (node == p->left) {
+				rotate_right(root, p);
+				node = p;
+				p = node->parent;
+			}
+			rotate_left(root, g);
+		}
+		p->red = 0;
+		g->red = 1;
+		break;
+	}
+	root->node->red = 0;
+}
+
+struct rb_node * rb_first(struct rb_root * root) {
+	return root->leftmost;
+}
+
+struct rb_node * rb_next(struct rb_node * node) {
+	if (node->right != NULL) {
+		node = node->right;
+		while (node->left != NULL)
+			node = node->left;
+		return node;
+	}
+	while (node->parent != NULL && node == node->parent->right)
+		node = node->parent;
+	return node->parent;
+}
+
+/* Rebalance after a black node was removed above [x], which may be a
+ * NULL leaf and therefore comes with its [parent] */
+static void erase_fixup(struct rb_root * root, struct rb_node * x,
+		struct rb_node * parent) {
+	while (x != root->node && !is_red(x)) {
+		if (x == parent->left) {
+			struct rb_node * w = parent->right;
+			if (is_red(w)) {
+				w->red = 0;
+				parent->red = 1;
+				rotate_left(root, parent);
+				w = parent->right;
+			}
+			if (!is_red(w->left) && !is_red(w->right)) {
+				w->red = 1;
+				x = parent;
+				parent = x->parent;
+				continue;
+			}
+			if (!is_red(w->right)) {
+				w->left->red = 0;
+				w->red = 1;
+				rotate_right(root, w);
+				w = parent->right;
+			}
+			w->red = parent->red;
+			parent->red = 0;
+			w->right->red = 0;
+			rotate_left(root, parent);
+		} else {
+			struct rb_node * w = parent->left;
+			if (is_red(w)) {
+				w->red = 0;
+				parent->red = 1;
+				rotate_right(root, parent);
+				w = parent->left;
+			}
+			if (!is_red(w->left) && !is_red(w->right)) {
+				w->red = 1;
+				x = parent;
+				parent = x->parent;
+				continue;
+			}
+			if (!is_red(w->left)) {
+				w->right->red = 0;
+				w->red = 1;
+				rotate_left(root, w);
+				w = parent->left;
+			}
+			w->red = parent->red;
+			parent->red = 0;
+			w->left->red = 0;
+			rotate_right(root, parent);
+		}
+		x = root->node;
+		break;
+	}
+	if (x != NULL)
+		x->red = 0;
+}
+
+void rb_erase(struct rb_root * root, struct rb_node * node) {
+	struct rb_node * x, * parent;
+	int removed_red;
+
+	if (root->leftmost == node)
+		root->leftmost = rb_next(node);
+
+	if (node->left == NULL || node->right == NULL) {
+		/* At most one child, it takes the place of [node] */
+		x = node->left != NULL ? node->left : node->right;
+		parent = node->parent;
+		removed_red = node->red;
+		if (x != NULL)
+			x->parent = parent;
+		change_child(root, parent, node, x);
+	} else {
+		/* Two children, the successor takes the place of [node] */
+		struct rb_node * succ = node->right;
+		while (succ->left != NULL)
+			succ = succ->left;
+		removed_red = succ->red;
+		x = succ->right;
+		if (succ->parent == node) {
+			parent = succ;
+		} else {
+			parent = succ->parent;
+			parent->left = x;
+			if (x != NULL)
+				x->parent = parent;
+			succ->right = node->right;
+			node->right->parent = succ;
+		}
+		succ->left = node->left;
+		node->left->parent = succ;
+		succ->parent = node->parent;
+		succ->red = node->red;
+		change_child(root, node->parent, node, succ);
+	}
+	if (!removed_red)
+		erase_fixup(root, x, parent);
+}
+
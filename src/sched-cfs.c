@@ -0,0 +1,114 @@
+/*
+ * Completely fair policy
+ * Runnable processes sit in a red-black tree keyed by their virtual
+ * runtime, the time they ran scaled down by a weight derived from their
+ * priority. The leftmost process, the one that got the least weighted
+ * CPU time so far, runs next for one time slot.
+ */
+
+#include "sched.h"
+#include "sched-policy.h"
+#include "rbtree.h"
+
+#include <stdlib.h>
+
+/* Weight of a priority 0..MAX_PRIO-1, mapped onto the 40 nice levels.
+ * Every level is worth about 10% of CPU time against its neighbour */
+static const int prio_to_weight[40] = {
+	88761, 71755, 56483, 46273, 36291,
+	29154, 23254, 18705, 14949, 11916,
+	 9548,  7620,  6100,  4904,  3906,
+	 3121,  2501,  1991,  1586,  1277,
+	 1024,   820,   655,   526,   423,
+	  335,   272,   215,   172,   137,
+	  110,    87,    70,    56,    45,
+	   36,    29,    23,    18,    15,
+};
+
+#define CFS_NICE_0_LOAD		1024
+#define CFS_VRUNTIME_SHIFT	10	/* Fixed point bits of vruntime */
+
+struct cfs_rq {
+	struct rb_root tasks_timeline;
+	uint64_t min_vruntime;	/* Never decreases, floor for arrivals */
+	int time_slot;
+};
+
+static int cfs_weight(struct pcb_t * proc) {
+	int prio = proc->prio < MAX_PRIO ? proc->prio : MAX_PRIO - 1;
+	return prio_to_weight[prio * 40 / MAX_PRIO];
+}
+
+static int cfs_less(const struct rb_node * a, const struct rb_node * b) {
+	return rb_entry(a, struct pcb_t, run_node)->vruntime <
+		rb_entry(b, struct pcb_t, run_node)->vruntime;
+}
+
+static void * cfs_init(int time_slot) {
+	struct cfs_rq * rq = calloc(1, sizeof(struct cfs_rq));
+	rq->time_slot = time_slot;
+	return rq;
+}
+
+static void cfs_finish(void * rq) {
+	free(rq);
+}
+
+/* A new process starts level with the most starved queued one */
+static void cfs_add(void * _rq, struct pcb_t * proc) {
+	struct cfs_rq * rq = _rq;
+
+	proc->vruntime = rq->min_vruntime;
+	rb_insert(&rq->tasks_timeline, &proc->run_node, cfs_less);
+}
+
+/* A process stolen from a CPU whose min_vruntime lags is pulled up to
+ * this one, so it cannot monopolize the CPU to catch up */
+static void cfs_put(void * _rq, struct pcb_t * proc) {
+	struct cfs_rq * rq = _rq;
+
+	if (proc->vruntime < rq->min_vruntime)
+		proc->vruntime = rq->min_vruntime;
+	rb_insert(&rq->tasks_timeline, &proc->run_node, cfs_less);
+}
+
+/* The fair order wins over cache affinity, [cpu] is not used */
+static struct pcb_t * cfs_get(void * _rq, int cpu) {
+	struct cfs_rq * rq = _rq;
+	struct rb_node * leftmost = rb_first(&rq->tasks_timeline);
+	struct pcb_t * proc;
+
+	if (leftmost == NULL)
+		return NULL;
+	rb_erase(&rq->tasks_timeline, leftmost);
+	proc = rb_entry(leftmost, struct pcb_t, run_node);
+	if (proc->vruntime > rq->min_vruntime)
+		rq->min_vruntime = proc->vruntime;
+	return proc;
+}
+
+static int cfs_tick(void * rq, struct pcb_t * proc) {
+	proc->vruntime += ((uint64_t)CFS_NICE_0_LOAD << CFS_VRUNTIME_SHIFT) /
+		cfs_weight(proc);
+	return proc->run_ticks >= ((struct cfs_rq *)rq)->time_slot;
+}
+
+static void cfs_for_each(void * rq, void (*fn)(struct pcb_t *, void *),
+		void * arg) {
+	struct rb_node * node;
+	for (node = rb_first(&((struct cfs_rq *)rq)->tasks_timeline);
+			node != NULL; node = rb_next(node))
+		fn(rb_entry(node, struct pcb_t, run_node), arg);
+}
+
+struct sched_policy sched_cfs_policy = {
+	.name = "cfs",
+	.init = cfs_init,
+	.finish = cfs_finish,
+	.add = cfs_add,
+	.put = cfs_put,
+	.get = cfs_get,
+	.tick = cfs_tick,
+	.for_each = cfs_for_each,
+};
+
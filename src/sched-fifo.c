@@ -0,0 +1,74 @@
+/*
+ * First-come first-served and round-robin policies
+ * Both keep a single FIFO queue per CPU, round robin additionally
+ * takes the CPU back after time_slot instructions.
+ */
+
+#include "queue.h"
+#include "sched-policy.h"
+
+#include <stdlib.h>
+
+struct fifo_rq {
+	struct queue_t ready_queue;
+	int time_slot;
+};
+
+static void * fifo_init(int time_slot) {
+	struct fifo_rq * rq = calloc(1, sizeof(struct fifo_rq));
+	rq->time_slot = time_slot;
+	return rq;
+}
+
+static void fifo_finish(void * rq) {
+	queue_free(&((struct fifo_rq *)rq)->ready_queue);
+	free(rq);
+}
+
+static void fifo_put(void * rq, struct pcb_t * proc) {
+	enqueue(&((struct fifo_rq *)rq)->ready_queue, proc);
+}
+
+static struct pcb_t * fifo_get(void * rq, int cpu) {
+	return sched_affinity_dequeue(&((struct fifo_rq *)rq)->ready_queue, cpu);
+}
+
+/* A process keeps the CPU until it finishes */
+static int fifo_tick(void * rq, struct pcb_t * proc) {
+	return 0;
+}
+
+static int rr_tick(void * rq, struct pcb_t * proc) {
+	return proc->run_ticks >= ((struct fifo_rq *)rq)->time_slot;
+}
+
+static void fifo_for_each(void * rq, void (*fn)(struct pcb_t *, void *),
+		void * arg) {
+	struct queue_t * q = &((struct fifo_rq *)rq)->ready_queue;
+	int i;
+	for (i = 0; i < q->size; i++)
+		fn(queue_at(q, i), arg);
+}
+
+struct sched_policy sched_fifo_policy = {
+	.name = "fifo",
+	.init = fifo_init,
+	.finish = fifo_finish,
+	.add = fifo_put,
+	.put = fifo_put,
+	.get = fifo_get,
+	.tick = fifo_tick,
+	.for_each = fifo_for_each,
+};
+
+struct sched_policy sched_rr_policy = {
+	.name = "rr",
+	.init = fifo_init,
+	.finish = fifo_finish,
+	.add = fifo_put,
+	.put = fifo_put,
+	.get = fifo_get,
+	.tick = rr_tick,
+	.for_each = fifo_for_each,
+};
+
@@ -0,0 +1,295 @@
+/*
+ * Multi-level queue policies
+ * MLQ serves the levels of mlq_ready_queue[] by fixed slot budgets,
+ * MLFQ always serves the best level and moves processes between
+ * levels by their behaviour.
+ */
+
+#include "queue.h"
+#include "sched.h"
+#include "sched-policy.h"
+#include "bitops.h"
+#include "timer.h"
+
+#include <stdlib.h>
+
+#define MLQ_BITS_PER_WORD	(BITS_PER_BYTE * sizeof(unsigned long))
+#define MLQ_BITMAP_WORDS	DIV_ROUND_UP(MAX_PRIO, MLQ_BITS_PER_WORD)
+
+/* One FIFO queue per priority level */
+struct prio_array {
+	struct queue_t mlq_ready_queue[MAX_PRIO];
+
+	/* Bitmap of the non-empty levels: bit [prio] is set iff
+	 * mlq_ready_queue[prio] holds a process. It lets the policies
+	 * find the next level with a find-first-set instead of a walk */
+	unsigned long mlq_bitmap[MLQ_BITMAP_WORDS];
+};
+
+/* Level of [proc], priorities past the last level share the last one */
+static int prio_level(struct pcb_t * proc) {
+	return proc->prio < MAX_PRIO ? proc->prio : MAX_PRIO - 1;
+}
+
+static void prio_array_enqueue(struct prio_array * arr, struct pcb_t * proc) {
+	int prio = prio_level(proc);
+	enqueue(&arr->mlq_ready_queue[prio], proc);
+	arr->mlq_bitmap[prio / MLQ_BITS_PER_WORD] |=
+		1UL << (prio % MLQ_BITS_PER_WORD);
+}
+
+/* Take a process of level [prio] for CPU [cpu], preferring one warm in
+ * its cache. The level is the priority band affinity may reorder in */
+static struct pcb_t * prio_array_dequeue(struct prio_array * arr, int prio,
+		int cpu) {
+	struct pcb_t * proc = sched_affinity_dequeue(&arr->mlq_ready_queue[prio],
+			cpu);
+	if (empty(&arr->mlq_ready_queue[prio]))
+		arr->mlq_bitmap[prio / MLQ_BITS_PER_WORD] &=
+			~(1UL << (prio % MLQ_BITS_PER_WORD));
+	return proc;
+}
+
+/* Return the first non-empty level at or after [from], MAX_PRIO if none */
+static int prio_array_find_next(struct prio_array * arr, int from) {
+	int w = from / MLQ_BITS_PER_WORD;
+	unsigned long word;
+
+	if (from >= MAX_PRIO)
+		return MAX_PRIO;
+	word = arr->mlq_bitmap[w] & (~0UL << (from % MLQ_BITS_PER_WORD));
+	while (word == 0) {
+		if (++w == MLQ_BITMAP_WORDS)
+			return MAX_PRIO;
+		word = arr->mlq_bitmap[w];
+	}
+	return w * MLQ_BITS_PER_WORD + __builtin_ctzl(word);
+}
+
+/* A lower level number is a higher priority */
+static int prio_preempt(struct pcb_t * proc, struct pcb_t * curr) {
+	return prio_level(proc) < prio_level(curr);
+}
+
+static void prio_array_free(struct prio_array * arr) {
+	int prio;
+	for (prio = 0; prio < MAX_PRIO; prio++)
+		queue_free(&arr->mlq_ready_queue[prio]);
+}
+
+static void prio_array_for_each(struct prio_array * arr,
+		void (*fn)(struct pcb_t *, void *), void * arg) {
+	int prio, i;
+	for (prio = prio_array_find_next(arr, 0); prio < MAX_PRIO;
+			prio = prio_array_find_next(arr, prio + 1))
+		for (i = 0; i < arr->mlq_ready_queue[prio].size; i++)
+			fn(queue_at(&arr->mlq_ready_queue[prio], i), arg);
+}
+
+/*
+ * MLQ
+ */
+
+struct mlq_rq {
+	struct prio_array arr;
+	int time_slot;
+
+	/* Per-level slot budgets. A level may serve MAX_PRIO - prio
+	 * dispatches per round; slot[prio] only counts for the round it
+	 * was stamped with, so starting a new round is a single increment
+	 * of mlq_round */
+	int slot[MAX_PRIO];
+	unsigned long slot_round[MAX_PRIO];
+	unsigned long mlq_round;
+	int mlq_cursor;		/* Level currently being served */
+};
+
+static void * mlq_init(int time_slot) {
+	struct mlq_rq * rq = calloc(1, sizeof(struct mlq_rq));
+	rq->time_slot = time_slot;
+	return rq;
+}
+
+static void mlq_finish(void * rq) {
+	prio_array_free(&((struct mlq_rq *)rq)->arr);
+	free(rq);
+}
+
+/* Dispatches level [prio] has left in the current round */
+static int mlq_budget(struct mlq_rq * rq, int prio) {
+	if (rq->slot_round[prio] != rq->mlq_round) {
+		rq->slot_round[prio] = rq->mlq_round;
+		rq->slot[prio] = 0;
+	}
+	return MAX_PRIO - prio - rq->slot[prio];
+}
+
+static void mlq_put(void * rq, struct pcb_t * proc) {
+	prio_array_enqueue(&((struct mlq_rq *)rq)->arr, proc);
+}
+
+/* A preempting arrival starts a new round from its own level, else the
+ * level under the cursor would keep the CPU while its budget lasts */
+static void mlq_add_preempting(void * _rq, struct pcb_t * proc) {
+	struct mlq_rq * rq = _rq;
+
+	prio_array_enqueue(&rq->arr, proc);
+	rq->mlq_round++;
+	rq->mlq_cursor = prio_level(proc);
+}
+
+/*
+ *  Stateful design for routine calling
+ *  based on the priority and our MLQ policy
+ *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO - prio)
+ *  The current level keeps the CPU until its budget runs out, then the
+ *  next non-empty level is served. Once no level is left the round ends,
+ *  every budget is refilled and serving restarts from level 0.
+ */
+static struct pcb_t * mlq_get(void * _rq, int cpu) {
+	struct mlq_rq * rq = _rq;
+	int prio;
+
+	prio = prio_array_find_next(&rq->arr, rq->mlq_cursor);
+	if (prio == rq->mlq_cursor && mlq_budget(rq, prio) <= 0)
+		prio = prio_array_find_next(&rq->arr, prio + 1);
+	if (prio == MAX_PRIO) {
+		/* Round is over, refill all budgets at once */
+		rq->mlq_round++;
+		prio = prio_array_find_next(&rq->arr, 0);
+	}
+	if (prio == MAX_PRIO) {
+		rq->mlq_cursor = 0;
+		return NULL;
+	}
+	rq->mlq_cursor = prio;
+	mlq_budget(rq, prio);
+	rq->slot[prio]++;
+	return prio_array_dequeue(&rq->arr, prio, cpu);
+}
+
+static int mlq_tick(void * rq, struct pcb_t * proc) {
+	return proc->run_ticks >= ((struct mlq_rq *)rq)->time_slot;
+}
+
+static void mlq_for_each(void * rq, void (*fn)(struct pcb_t *, void *),
+		void * arg) {
+	prio_array_for_each(&((struct mlq_rq *)rq)->arr, fn, arg);
+}
+
+struct sched_policy sched_mlq_policy = {
+	.name = "mlq",
+	.init = mlq_init,
+	.finish = mlq_finish,
+	.add = mlq_put,
+	.add_preempting = mlq_add_preempting,
+	.put = mlq_put,
+	.get = mlq_get,
+	.tick = mlq_tick,
+	.preempt = prio_preempt,
+	.for_each = mlq_for_each,
+};
+
+/*
+ * MLFQ
+ * A process starts at its configured priority. The best non-empty level
+ * always runs first; a process that uses up its whole quantum is
+ * demoted one level, so CPU-bound work sinks below interactive work,
+ * while one that yields early keeps its level. A process that waited
+ * MLFQ_AGE_QUANTA quanta on its level is promoted one level, so the
+ * sunk work still makes progress.
+ */
+
+#define MLFQ_AGE_QUANTA		8
+
+struct mlfq_rq {
+	struct prio_array arr;
+	int time_slot;
+
+	/* Next level whose oldest process is checked for aging. Levels are
+	 * FIFO, so their head is the one that waited longest and each get
+	 * checks a single head rather than scanning every process */
+	int age_cursor;
+};
+
+static void mlfq_enqueue(struct mlfq_rq * rq, struct pcb_t * proc) {
+	proc->enqueue_time = current_time();
+	prio_array_enqueue(&rq->arr, proc);
+}
+
+/* Promote the head of the next non-empty level if it waited too long */
+static void mlfq_age(struct mlfq_rq * rq) {
+	struct pcb_t * proc;
+	int prio = prio_array_find_next(&rq->arr, rq->age_cursor);
+
+	if (prio == MAX_PRIO)
+		prio = prio_array_find_next(&rq->arr, 0);
+	if (prio == MAX_PRIO)
+		return;
+	rq->age_cursor = prio + 1;
+	if (prio == 0)
+		return;
+	proc = queue_at(&rq->arr.mlq_ready_queue[prio], 0);
+	if (current_time() - proc->enqueue_time <
+			(uint64_t)MLFQ_AGE_QUANTA * rq->time_slot)
+		return;
+	prio_array_dequeue(&rq->arr, prio, -1);
+	proc->prio = prio - 1;
+	mlfq_enqueue(rq, proc);
+}
+
+static void * mlfq_init(int time_slot) {
+	struct mlfq_rq * rq = calloc(1, sizeof(struct mlfq_rq));
+	rq->time_slot = time_slot;
+	return rq;
+}
+
+static void mlfq_finish(void * rq) {
+	prio_array_free(&((struct mlfq_rq *)rq)->arr);
+	free(rq);
+}
+
+static void mlfq_add(void * rq, struct pcb_t * proc) {
+	mlfq_enqueue(rq, proc);
+}
+
+static void mlfq_put(void * _rq, struct pcb_t * proc) {
+	struct mlfq_rq * rq = _rq;
+
+	if (proc->run_ticks >= rq->time_slot && proc->prio < MAX_PRIO - 1)
+		proc->prio++;
+	mlfq_enqueue(rq, proc);
+}
+
+static struct pcb_t * mlfq_get(void * _rq, int cpu) {
+	struct mlfq_rq * rq = _rq;
+	int prio;
+
+	mlfq_age(rq);
+	prio = prio_array_find_next(&rq->arr, 0);
+	if (prio == MAX_PRIO)
+		return NULL;
+	return prio_array_dequeue(&rq->arr, prio, cpu);
+}
+
+static int mlfq_tick(void * rq, struct pcb_t * proc) {
+	return proc->run_ticks >= ((struct mlfq_rq *)rq)->time_slot;
+}
+
+static void mlfq_for_each(void * rq, void (*fn)(struct pcb_t *, void *),
+		void * arg) {
+	prio_array_for_each(&((struct mlfq_rq *)rq)->arr, fn, arg);
+}
+
+struct sched_policy sched_mlfq_policy = {
+	.name = "mlfq",
+	.init = mlfq_init,
+	.finish = mlfq_finish,
+	.add = mlfq_add,
+	.put = mlfq_put,
+	.get = mlfq_get,
+	.tick = mlfq_tick,
+	.preempt = prio_preempt,
+	.for_each = mlfq_for_each,
+};
+
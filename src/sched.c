@@ -1,184 +1,561 @@
 
 #include "queue.h"
 #include "sched.h"
-
-static struct queue_t ready_queue;
-static struct queue_t run_queue;
+#include "sched-policy.h"
+#include "timer.h"
+#include "sim.h"
 
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+static struct sched_policy * policies[] = {
+	&sched_fifo_policy,
+	&sched_rr_policy,
+	&sched_mlq_policy,
+	&sched_mlfq_policy,
+	&sched_cfs_policy,
+	NULL,
+};
+
+/* Binary min-heap of the processes that have a deadline, earliest
+ * deadline at the root */
+struct edf_heap {
+	struct pcb_t ** proc;
+	int size;
+	int capacity;
+};
+
+/* Run queue owned by one simulated CPU. Every CPU dispatches from its
+ * own queue under its own lock, so CPUs only meet on a lock when one
+ * of them steals work or the loader places a new process */
+struct runqueue {
+	pthread_mutex_t lock;
+	int nr_queued;		/* Processes waiting in this queue */
+	int online;		/* The CPU takes new work, set under lock */
+
+	void * policy_rq;	/* Queued processes, ordered by the policy */
+
+	/* Processes dispatched by this CPU and not yet put back or
+	 * finished, linked through pcb_t::run_prev/run_next. A CPU runs
+	 * one process at a time, the head of the list */
+	struct pcb_t * running_list;
+
+	/* Set by add_proc() to make the running process yield at its
+	 * next instruction boundary */
+	int need_resched;
 
-static pthread_mutex_t queue_lock;
-static struct queue_t running_list;
-#ifdef MLQ_SCHED
-static struct queue_t mlq_ready_queue[MAX_PRIO];
-static int slot[MAX_PRIO];
-#endif
+	/* Dispatches, and those of processes that last ran elsewhere */
+	unsigned long nr_dispatches;
+	unsigned long nr_migrations;
+};
+
+/* Scheduler state of a simulation, sim->sched */
+struct sched_ctx {
+	struct sched_policy * policy;
+	struct runqueue * runqueues;
+	int nr_runqueues;
+	int next_placement;	/* Tie breaker for add_proc() */
+	int time_slot;
+	int preempt;		/* Arrivals may preempt running processes */
+	int threaded;		/* CPUs run on several host threads */
+	void (*wake)(void);	/* Called once a process got queued */
+
+	/* Real-time class, always served before the policies of the run
+	 * queues. One heap for every CPU, so that the earliest deadline
+	 * runs first wherever it was queued */
+	pthread_mutex_t edf_lock;
+	struct edf_heap edf;
+	int nr_edf_queued;	/* edf.size, read without the lock */
+
+	/* Deadline processes that finished, and those of them that were
+	 * late */
+	int edf_finished;
+	int edf_missed;
+};
+
+/* A run without host threads to race with leaves the locks alone */
+static void rq_lock(struct runqueue * rq) {
+	if (sim->sched->threaded)
+		pthread_mutex_lock(&rq->lock);
+}
+
+static void rq_unlock(struct runqueue * rq) {
+	if (sim->sched->threaded)
+		pthread_mutex_unlock(&rq->lock);
+}
+
+static void edf_lock(struct sched_ctx * sc) {
+	if (sc->threaded)
+		pthread_mutex_lock(&sc->edf_lock);
+}
+
+static void edf_unlock(struct sched_ctx * sc) {
+	if (sc->threaded)
+		pthread_mutex_unlock(&sc->edf_lock);
+}
+
+void sched_set_threaded(int threaded) {
+	sim->sched->threaded = threaded;
+}
+
+void sched_set_wake(void (*wake)(void)) {
+	sim->sched->wake = wake;
+}
+
+/* Tell the owner of the CPUs that a process is waiting. Called without
+ * run queue locks held */
+static void sched_wake(void) {
+	if (sim->sched->wake != NULL)
+		sim->sched->wake();
+}
 
 int queue_empty(void) {
-#ifdef MLQ_SCHED
-	unsigned long prio;
-	for (prio = 0; prio < MAX_PRIO; prio++)
-		if(!empty(&mlq_ready_queue[prio])) 
-			return -1;
-#endif
-	return (empty(&ready_queue) && empty(&run_queue));
-}
-
-//Tham khao
-int MarkedPrior = 0 ;
-int flag = 1;
-int count = 0;
-
-
-void init_scheduler(void) {
-#ifdef MLQ_SCHED
-    int i ;
-
-	for (i = 0; i < MAX_PRIO; i ++) {
-		mlq_ready_queue[i].size = 0;
-		slot[i] = MAX_PRIO - i; 
-	}
-#endif
-	ready_queue.size = 0;
-	run_queue.size = 0;
-	pthread_mutex_init(&queue_lock, NULL);
-}
-
-#ifdef MLQ_SCHED
-/* 
- *  Stateful design for routine calling
- *  based on the priority and our MLQ policy
- *  We implement stateful here using transition technique
- *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO - prio)
- */
-struct pcb_t * get_mlq_proc(void) {
-	 struct pcb_t * proc = NULL;
-	// /*TODO: get a process from PRIORITY [ready_queue].
-	//  * Remember to use lock to protect the queue.
-	//  * */
-	pthread_mutex_lock(&queue_lock);
-	label: 
-	if(flag){
-		for(; MarkedPrior < MAX_PRIO; MarkedPrior++){
-			if(mlq_ready_queue[MarkedPrior].size != 0 && slot[MarkedPrior] < MAX_PRIO - MarkedPrior){
-				proc = dequeue(&mlq_ready_queue[MarkedPrior]);
-				slot[MarkedPrior]++;
-				flag = 0;
-				count = 0;
-				pthread_mutex_unlock(&queue_lock);
-				return proc;
-			}
-			count++;
-		}
-		for(int j = 0; j < MAX_PRIO; j++){
-			slot[j] = 0;
-		}
-		MarkedPrior = 0;
-		flag = 1;
-		if(count == MAX_PRIO){
-			pthread_mutex_unlock(&queue_lock);
-			return proc;
-		}else{
-			count = 0;
-		}
-		goto label;
-	}else{
-		if(slot[MarkedPrior] < MAX_PRIO - MarkedPrior && mlq_ready_queue[MarkedPrior].size != 0 ){
-			proc = dequeue(&mlq_ready_queue[MarkedPrior]);
-			slot[MarkedPrior]++;
-			pthread_mutex_unlock(&queue_lock);
-			return proc;
-		}else{
-			flag = 1;
-			goto label;
-		}
+	struct sched_ctx * sc = sim->sched;
+	int cpu;
+	if (__atomic_load_n(&sc->nr_edf_queued, __ATOMIC_RELAXED))
+		return 0;
+	for (cpu = 0; cpu < sc->nr_runqueues; cpu++)
+		if (__atomic_load_n(&sc->runqueues[cpu].nr_queued,
+				__ATOMIC_RELAXED))
+			return 0;
+	return 1;
+}
+
+int init_scheduler(int num_cpus, int time_slot, const char * name,
+		int preempt) {
+	struct sched_ctx * sc = calloc(1, sizeof(struct sched_ctx));
+	int cpu, i;
+
+	sim->sched = sc;
+	sc->policy = NULL;
+	for (i = 0; policies[i] != NULL; i++)
+		if (!strcmp(policies[i]->name, name))
+			sc->policy = policies[i];
+	if (sc->policy == NULL) {
+		free(sc);
+		sim->sched = NULL;
+		return -1;
 	}
-	pthread_mutex_unlock(&queue_lock);
-	return proc;	
+
+	sc->time_slot = time_slot;
+	sc->preempt = preempt;
+	sc->threaded = 1;
+	sc->nr_runqueues = num_cpus;
+	sc->runqueues = calloc(num_cpus, sizeof(struct runqueue));
+	pthread_mutex_init(&sc->edf_lock, NULL);
+	for (cpu = 0; cpu < num_cpus; cpu++) {
+		pthread_mutex_init(&sc->runqueues[cpu].lock, NULL);
+		sc->runqueues[cpu].online = 1;
+		sc->runqueues[cpu].policy_rq = sc->policy->init(time_slot);
+	}
+	return 0;
 }
 
-void put_mlq_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);
+void finish_scheduler(void) {
+	struct sched_ctx * sc = sim->sched;
+	int cpu;
+	for (cpu = 0; cpu < sc->nr_runqueues; cpu++) {
+		struct runqueue * rq = &sc->runqueues[cpu];
+		sim_printf("CPU %d: %lu dispatches, %lu migrations\n",
+			cpu, rq->nr_dispatches, rq->nr_migrations);
+		sc->policy->finish(rq->policy_rq);
+		pthread_mutex_destroy(&rq->lock);
+	}
+	free(sc->edf.proc);
+	pthread_mutex_destroy(&sc->edf_lock);
+	if (sc->edf_finished > 0)
+		sim_printf("EDF: %d of %d deadline processes missed their deadline\n",
+			sc->edf_missed, sc->edf_finished);
+	free(sc->runqueues);
+	free(sc);
+	sim->sched = NULL;
 }
 
-void add_mlq_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);	
+static void edf_swap(struct edf_heap * h, int i, int j) {
+	struct pcb_t * tmp = h->proc[i];
+	h->proc[i] = h->proc[j];
+	h->proc[j] = tmp;
 }
 
-struct pcb_t * get_proc(void) {
-	return get_mlq_proc();
+static void edf_push(struct edf_heap * h, struct pcb_t * proc) {
+	int i;
+
+	if (h->size == h->capacity) {
+		h->capacity = h->capacity ? 2 * h->capacity : QUEUE_INIT_CAPACITY;
+		h->proc = realloc(h->proc, sizeof(struct pcb_t *) * h->capacity);
+	}
+	i = h->size++;
+	h->proc[i] = proc;
+	while (i > 0 && h->proc[i]->deadline < h->proc[(i - 1) / 2]->deadline) {
+		edf_swap(h, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
 }
 
-void put_proc(struct pcb_t * proc) {
-	proc->ready_queue = &ready_queue;
-	proc->mlq_ready_queue = mlq_ready_queue;
-	proc->running_list = & running_list;
+static struct pcb_t * edf_pop(struct edf_heap * h) {
+	struct pcb_t * proc;
+	int i = 0;
 
-	/* TODO: put running proc to running_list */
-    pthread_mutex_lock(&queue_lock);
-	enqueue(&running_list,proc);
-	pthread_mutex_unlock(&queue_lock);
+	if (h->size == 0)
+		return NULL;
+	proc = h->proc[0];
+	h->proc[0] = h->proc[--h->size];
+	while (1) {
+		int min = i, l = 2 * i + 1, r = 2 * i + 2;
+		if (l < h->size && h->proc[l]->deadline < h->proc[min]->deadline)
+			min = l;
+		if (r < h->size && h->proc[r]->deadline < h->proc[min]->deadline)
+			min = r;
+		if (min == i)
+			break;
+		edf_swap(h, i, min);
+		i = min;
+	}
+	return proc;
+}
+
+struct pcb_t * sched_affinity_dequeue(struct queue_t * q, int cpu) {
+	int i, pick = -1;
+
+	if (empty(q))
+		return NULL;
+	for (i = 0; cpu >= 0 && i < q->size && i < SCHED_AFFINITY_SCAN; i++) {
+		int last_cpu = queue_at(q, i)->last_cpu;
+		if (last_cpu == cpu) {
+			pick = i;
+			break;
+		}
+		if (last_cpu < 0 && pick < 0)
+			pick = i;
+	}
+	return queue_remove(q, pick < 0 ? 0 : pick);
+}
 
-	return put_mlq_proc(proc);
+/* Take the next process of [rq] for CPU [cpu] by the configured
+ * policy. Caller holds rq->lock */
+static struct pcb_t * rq_pick(struct runqueue * rq, int cpu) {
+	struct pcb_t * proc = sim->sched->policy->get(rq->policy_rq, cpu);
+	if (proc != NULL)
+		__atomic_sub_fetch(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+	return proc;
 }
 
-void add_proc(struct pcb_t * proc) {
-	proc->ready_queue = &ready_queue;
-	proc->mlq_ready_queue = mlq_ready_queue;
-	proc->running_list = & running_list;
+/* Queue [proc] on [rq], as a new process or as one that ran already.
+ * A deadline process goes to the shared heap instead. Caller holds
+ * rq->lock, which is taken before edf_lock */
+static void rq_enqueue(struct runqueue * rq, struct pcb_t * proc, int new) {
+	struct sched_ctx * sc = sim->sched;
+
+	if (proc->deadline) {
+		edf_lock(sc);
+		edf_push(&sc->edf, proc);
+		__atomic_store_n(&sc->nr_edf_queued, sc->edf.size,
+			__ATOMIC_RELAXED);
+		edf_unlock(sc);
+		return;
+	}
+	if (new)
+		sc->policy->add(rq->policy_rq, proc);
+	else
+		sc->policy->put(rq->policy_rq, proc);
+	__atomic_add_fetch(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+}
+
+/* Link [proc] into the running list of [rq]. Caller holds rq->lock */
+static void running_add(struct runqueue * rq, struct pcb_t * proc) {
+	int cpu = rq - sim->sched->runqueues;
 
-	/* TODO: put running proc to running_list */
-	pthread_mutex_lock(&queue_lock);
-    enqueue(&running_list,proc);
-	pthread_mutex_unlock(&queue_lock);
+	/* A pending request was meant for the previous process */
+	__atomic_store_n(&rq->need_resched, 0, __ATOMIC_RELAXED);
+	rq->nr_dispatches++;
+	if (proc->last_cpu >= 0 && proc->last_cpu != cpu)
+		rq->nr_migrations++;
+	proc->last_cpu = cpu;
+	proc->run_ticks = 0;
+	proc->run_prev = NULL;
+	proc->run_next = rq->running_list;
+	if (rq->running_list != NULL)
+		rq->running_list->run_prev = proc;
+	rq->running_list = proc;
+}
 
-	return add_mlq_proc(proc);
+/* Unlink [proc] from the running list of [rq]. Caller holds rq->lock */
+static void running_del(struct runqueue * rq, struct pcb_t * proc) {
+	if (proc->run_prev != NULL)
+		proc->run_prev->run_next = proc->run_next;
+	else
+		rq->running_list = proc->run_next;
+	if (proc->run_next != NULL)
+		proc->run_next->run_prev = proc->run_prev;
+	proc->run_prev = NULL;
+	proc->run_next = NULL;
 }
-#else
-struct pcb_t * get_proc(void) {
+
+/* Steal the next process of another CPU. Peers are visited round robin
+ * from [cpu] + 1 and only locked when they look busy, so idle CPUs do
+ * not convoy on each other's locks */
+static struct pcb_t * steal_proc(int cpu) {
+	struct sched_ctx * sc = sim->sched;
 	struct pcb_t * proc = NULL;
-	/*TODO: get a process from [ready_queue].
-	 * Remember to use lock to protect the queue.
-	 * */
-    pthread_mutex_lock(&queue_lock);
-	
-	proc = dequeue(&ready_queue);
-	
-	pthread_mutex_unlock(&queue_lock);
+	int i;
 
+	for (i = 1; i < sc->nr_runqueues && proc == NULL; i++) {
+		struct runqueue * peer =
+			&sc->runqueues[(cpu + i) % sc->nr_runqueues];
+		if (__atomic_load_n(&peer->nr_queued, __ATOMIC_RELAXED) == 0)
+			continue;
+		rq_lock(peer);
+		proc = rq_pick(peer, cpu);
+		rq_unlock(peer);
+	}
+	return proc;
+}
 
+/* Take the queued process with the earliest deadline, NULL if none */
+static struct pcb_t * edf_pick(void) {
+	struct sched_ctx * sc = sim->sched;
+	struct pcb_t * proc;
+
+	if (__atomic_load_n(&sc->nr_edf_queued, __ATOMIC_RELAXED) == 0)
+		return NULL;
+	edf_lock(sc);
+	proc = edf_pop(&sc->edf);
+	__atomic_store_n(&sc->nr_edf_queued, sc->edf.size, __ATOMIC_RELAXED);
+	edf_unlock(sc);
 	return proc;
 }
 
-void put_proc(struct pcb_t * proc) {
-	proc->ready_queue = &ready_queue;
-	proc->running_list = & running_list;
+struct pcb_t * get_proc(int cpu) {
+	struct runqueue * rq = &sim->sched->runqueues[cpu];
+	struct pcb_t * proc = edf_pick();
+
+	if (proc != NULL) {
+		rq_lock(rq);
+		running_add(rq, proc);
+		rq_unlock(rq);
+		return proc;
+	}
+	if (__atomic_load_n(&rq->nr_queued, __ATOMIC_RELAXED) != 0) {
+		rq_lock(rq);
+		proc = rq_pick(rq, cpu);
+		if (proc != NULL)
+			running_add(rq, proc);
+		rq_unlock(rq);
+	}
+	if (proc == NULL) {
+		proc = steal_proc(cpu);
+		if (proc != NULL) {
+			rq_lock(rq);
+			running_add(rq, proc);
+			rq_unlock(rq);
+		}
+	}
+	return proc;
+}
+
+void put_proc(int cpu, struct pcb_t * proc) {
+	struct runqueue * rq = &sim->sched->runqueues[cpu];
+
+	/* A preempted process goes back to the CPU it ran on */
+	rq_lock(rq);
+	running_del(rq, proc);
+	rq_enqueue(rq, proc, 0);
+	rq_unlock(rq);
+	sched_wake();
+}
+
+/* Return 1 when [proc] should run before [curr]. Deadline processes
+ * come before all others and among themselves the earliest deadline
+ * wins, the policy orders the rest */
+static int sched_preempts(struct pcb_t * proc, struct pcb_t * curr) {
+	struct sched_policy * policy = sim->sched->policy;
+
+	if (proc->deadline || curr->deadline)
+		return proc->deadline &&
+			(!curr->deadline || proc->deadline < curr->deadline);
+	return policy->preempt != NULL && policy->preempt(proc, curr);
+}
+
+/* Queue the new process [proc] on the CPU running the lowest priority
+ * process that [proc] preempts and ask that CPU to yield. Return 0
+ * when no CPU has to yield, that is when one is idle or all of them
+ * run something at least as important */
+static int add_proc_preempt(struct pcb_t * proc) {
+	struct sched_ctx * sc = sim->sched;
+	struct runqueue * rq;
+	struct pcb_t * victim = NULL;
+	int best = -1;
+	int cpu;
+
+	/* Every run queue is locked, in order, so that no CPU switches its
+	 * running process while they are compared. Other paths never hold
+	 * two run queue locks at once */
+	for (cpu = 0; cpu < sc->nr_runqueues; cpu++)
+		rq_lock(&sc->runqueues[cpu]);
+	for (cpu = 0; cpu < sc->nr_runqueues; cpu++) {
+		struct pcb_t * curr = sc->runqueues[cpu].running_list;
+		if (!sc->runqueues[cpu].online)
+			continue;
+		if (curr == NULL) {
+			best = -1;
+			break;
+		}
+		if (!sched_preempts(proc, curr))
+			continue;
+		if (victim == NULL || sched_preempts(victim, curr)) {
+			victim = curr;
+			best = cpu;
+		}
+	}
+	if (best >= 0) {
+		rq = &sc->runqueues[best];
+		if (!proc->deadline && sc->policy->add_preempting != NULL) {
+			sc->policy->add_preempting(rq->policy_rq, proc);
+			__atomic_add_fetch(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+		} else {
+			rq_enqueue(rq, proc, 1);
+		}
+		__atomic_store_n(&rq->need_resched, 1, __ATOMIC_RELAXED);
+	}
+	for (cpu = sc->nr_runqueues - 1; cpu >= 0; cpu--)
+		rq_unlock(&sc->runqueues[cpu]);
+	return best >= 0;
+}
 
-	/* TODO: put running proc to running_list */
+/* Queue [proc] on the least loaded online CPU. The loads are read
+ * without locks, a stale value only costs balance, which stealing
+ * makes up for later */
+static void place_proc(struct pcb_t * proc, int new) {
+	struct sched_ctx * sc = sim->sched;
+	struct runqueue * rq;
+	int start = __atomic_fetch_add(&sc->next_placement, 1,
+			__ATOMIC_RELAXED);
+	int best, best_load = 0;
+	int i;
 
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&running_list,proc);
-//	enqueue(&ready_queue,proc);
-	pthread_mutex_unlock(&queue_lock);
+	do {
+		best = -1;
+		for (i = 0; i < sc->nr_runqueues; i++) {
+			int cpu = (start + i) % sc->nr_runqueues;
+			int load = __atomic_load_n(&sc->runqueues[cpu].nr_queued,
+					__ATOMIC_RELAXED);
+			if (!__atomic_load_n(&sc->runqueues[cpu].online,
+						__ATOMIC_RELAXED))
+				continue;
+			if (best < 0 || load < best_load) {
+				best = cpu;
+				best_load = load;
+			}
+		}
+		/* With no CPU online, keep it for the first one */
+		rq = &sc->runqueues[best < 0 ? 0 : best];
+		rq_lock(rq);
+		if (rq->online || best < 0)
+			break;
+		/* The CPU went offline meanwhile, try again */
+		rq_unlock(rq);
+	} while (1);
+	rq_enqueue(rq, proc, new);
+	rq_unlock(rq);
 }
 
 void add_proc(struct pcb_t * proc) {
-	proc->ready_queue = &ready_queue;
-	proc->running_list = & running_list;
+	proc->last_cpu = -1;
+	if (!sim->sched->preempt || !add_proc_preempt(proc))
+		place_proc(proc, 1);
+	sched_wake();
+}
 
-	/* TODO: put running proc to running_list */
+void sched_cpu_online(int cpu) {
+	struct runqueue * rq = &sim->sched->runqueues[cpu];
 
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&running_list,proc);
-//	enqueue(&ready_queue,proc);
-	pthread_mutex_unlock(&queue_lock);	
+	rq_lock(rq);
+	__atomic_store_n(&rq->online, 1, __ATOMIC_RELAXED);
+	rq_unlock(rq);
 }
-#endif
 
+void sched_cpu_offline(int cpu) {
+	struct runqueue * rq = &sim->sched->runqueues[cpu];
+	struct pcb_t ** moved;
+	int nr = 0, i;
 
+	/* Empty the queue first and place the processes afterwards, so
+	 * that no two run queue locks are held at once */
+	rq_lock(rq);
+	__atomic_store_n(&rq->online, 0, __ATOMIC_RELAXED);
+	moved = malloc(sizeof(struct pcb_t *) * (rq->nr_queued + 1));
+	while ((moved[nr] = rq_pick(rq, -1)) != NULL)
+		nr++;
+	rq_unlock(rq);
+
+	for (i = 0; i < nr; i++)
+		place_proc(moved[i], 0);
+	free(moved);
+	if (nr > 0)
+		sched_wake();
+}
+
+void exit_proc(int cpu, struct pcb_t * proc) {
+	struct sched_ctx * sc = sim->sched;
+	struct runqueue * rq = &sc->runqueues[cpu];
+
+	rq_lock(rq);
+	running_del(rq, proc);
+	rq_unlock(rq);
+
+	if (proc->deadline) {
+		__atomic_add_fetch(&sc->edf_finished, 1, __ATOMIC_RELAXED);
+		if (current_time() > proc->deadline) {
+			__atomic_add_fetch(&sc->edf_missed, 1, __ATOMIC_RELAXED);
+			sim_printf("\tProcess %2d missed its deadline %lu by %lu\n",
+				proc->pid, proc->deadline,
+				current_time() - proc->deadline);
+		}
+	}
+}
+
+int sched_tick(int cpu, struct pcb_t * proc) {
+	struct runqueue * rq = &sim->sched->runqueues[cpu];
+
+	proc->run_ticks++;
+	if (__atomic_load_n(&rq->need_resched, __ATOMIC_RELAXED) &&
+			__atomic_exchange_n(&rq->need_resched, 0,
+				__ATOMIC_RELAXED))
+		return 1;
+	/* A deadline process is only taken off the CPU at the end of its
+	 * slice, so that an earlier deadline that arrived meanwhile runs */
+	if (proc->deadline)
+		return proc->run_ticks >= sim->sched->time_slot;
+	return sim->sched->policy->tick(rq->policy_rq, proc);
+}
+
+void sched_for_each_running(void (*fn)(struct pcb_t *, void *), void * arg) {
+	struct sched_ctx * sc = sim->sched;
+	int cpu;
+	for (cpu = 0; cpu < sc->nr_runqueues; cpu++) {
+		struct runqueue * rq = &sc->runqueues[cpu];
+		struct pcb_t * proc;
+		rq_lock(rq);
+		for (proc = rq->running_list; proc != NULL; proc = proc->run_next)
+			fn(proc, arg);
+		rq_unlock(rq);
+	}
+}
+
+void sched_for_each_queued(void (*fn)(struct pcb_t *, void *), void * arg) {
+	struct sched_ctx * sc = sim->sched;
+	int cpu, i;
+
+	edf_lock(sc);
+	for (i = 0; i < sc->edf.size; i++)
+		fn(sc->edf.proc[i], arg);
+	edf_unlock(sc);
+	for (cpu = 0; cpu < sc->nr_runqueues; cpu++) {
+		struct runqueue * rq = &sc->runqueues[cpu];
+		rq_lock(rq);
+		sc->policy->for_each(rq->policy_rq, fn, arg);
+		rq_unlock(rq);
+	}
+}
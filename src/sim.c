@@ -0,0 +1,52 @@
+#include "sim.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+
+__thread struct sim_ctx * sim;
+
+struct sim_thread {
+	struct sim_ctx * ctx;
+	void * (*fn)(void *);
+	void * arg;
+};
+
+struct sim_ctx * sim_create(FILE * out) {
+	struct sim_ctx * ctx = calloc(1, sizeof(struct sim_ctx));
+	ctx->out = out;
+	ctx->avail_pid = 1;
+	return ctx;
+}
+
+void sim_destroy(struct sim_ctx * ctx) {
+	free(ctx);
+}
+
+void sim_printf(const char * fmt, ...) {
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(sim != NULL ? sim->out : stdout, fmt, ap);
+	va_end(ap);
+}
+
+static void * sim_thread_start(void * args) {
+	struct sim_thread t = *(struct sim_thread *)args;
+
+	free(args);
+	sim = t.ctx;
+	return t.fn(t.arg);
+}
+
+int sim_thread_create(pthread_t * thread, void * (*fn)(void *), void * arg) {
+	struct sim_thread * t = malloc(sizeof(struct sim_thread));
+	int ret;
+
+	t->ctx = sim;
+	t->fn = fn;
+	t->arg = arg;
+	ret = pthread_create(thread, NULL, sim_thread_start, t);
+	if (ret != 0)
+		free(t);
+	return ret;
+}
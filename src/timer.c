@@ -1,136 +1,414 @@
-
 #include "timer.h"
+#include "sim.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * The clock is a barrier shared by every device. A device that is done
+ * with its slot bumps the arrival count; the last one to arrive
+ * advances the clock, which releases the others at once instead of
+ * waking them one by one. Waiters spin
+ * for a while, since a slot is usually short, then park on a condition
+ * variable so that oversubscribed hosts do not burn their cores.
+ *
+ * In fast-forward mode each arrival also carries the first slot the
+ * device needs to run in, and the clock jumps straight to the earliest
+ * of them. Slots nobody needs are skipped instead of being run through
+ * the barrier one by one.
+ *
+ * In parallel discrete-event (PDES) mode every device keeps a local
+ * clock instead. A device about to run work that touches no shared
+ * state calls timer_advance(), which records its arrival at its current
+ * slot in pending[] and moves on without waiting, up to PDES_WINDOW
+ * slots ahead of the clock. The clock is then the slowest device: slot
+ * t closes once every device arrived at it. next_slot() still waits for
+ * the clock to catch up with the local one, so everything a device does
+ * on shared state happens in the same slot as in lockstep.
+ *
+ * A device that knows its next slots touch no shared state can also
+ * skip them with timer_skip(): it leaves the barrier and is counted in
+ * again when the clock reaches the slot after them, so the slots in
+ * between close without a round trip through it.
+ */
+
+/* Barrier state packed in one word: attached devices in the high half,
+ * devices that arrived in the current slot in the low half. Packing
+ * them lets the last arrival and a detach agree on who closes the slot
+ * with a single atomic operation */
+#define BARRIER_NR_SHIFT	32
+#define BARRIER_ARRIVED_MASK	0xffffffffULL
+#define BARRIER_NR(s)		((uint32_t)((s) >> BARRIER_NR_SHIFT))
+#define BARRIER_ARRIVED(s)	((uint32_t)((s) & BARRIER_ARRIVED_MASK))
 
-static pthread_t _timer;
+/* Polls of the sense before a waiter parks. Spinning only pays when
+ * every device has a host core to itself */
+#define BARRIER_SPIN		1000
 
 struct timer_id_container_t {
 	struct timer_id_t id;
 	struct timer_id_container_t * next;
 };
 
-static struct timer_id_container_t * dev_list = NULL;
-
-static uint64_t _time;
-
-static int timer_started = 0;
-static int timer_stop = 0;
-
-
-static void * timer_routine(void * args) {
-	while (!timer_stop) {
-		printf("Time slot %3lu\n", current_time());
-		int fsh = 0;
-		int event = 0;
-		/* Wait for all devices have done the job in current
-		 * time slot */
-		struct timer_id_container_t * temp;
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.event_lock);
-			while (!temp->id.done && !temp->id.fsh) {
-				pthread_cond_wait(
-					&temp->id.event_cond,
-					&temp->id.event_lock
-				);
-			}
-			if (temp->id.fsh) {
-				fsh++;
-			}
-			event++;
-			pthread_mutex_unlock(&temp->id.event_lock);
-		}
-
-		/* Increase the time slot */
-		_time++;
-		
-		/* Let devices continue their job */
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.timer_lock);
-			temp->id.done = 0;
-			pthread_cond_signal(&temp->id.timer_cond);
-			pthread_mutex_unlock(&temp->id.timer_lock);
-		}
-		if (fsh == event) {
-			break;
-		}
+#define PDES_WINDOW		64
+
+/* Arrivals at slot t are counted in pending[t % PDES_WINDOW], tagged
+ * with the low half of t so that an entry left from slot t - PDES_WINDOW
+ * is recognised and restarted */
+#define PDES_TAG(e)		((uint32_t)((e) >> 32))
+#define PDES_COUNT(e)		((uint32_t)(e))
+
+/* Devices skipping up to slot t are counted in skip_count[t %
+ * SKIP_WINDOW]. The clock stops at every such slot, so an entry is
+ * always taken before it can be reused */
+#define SKIP_WINDOW		(TIMER_MAX_SKIP + 1)
+
+/* Clock of a simulation, sim->timer */
+struct timer_ctx {
+	struct timer_id_container_t * dev_list;
+
+	uint64_t time;
+
+	uint64_t barrier_state;
+	int barrier_spin;	/* Polls before a waiter sleeps, atomic */
+
+	int fast_forward;
+	uint64_t barrier_wake;	/* Earliest declared wake */
+
+	int pdes;
+	uint64_t pending[PDES_WINDOW];
+	pthread_mutex_t pdes_release_lock;
+
+	uint32_t skip_count[SKIP_WINDOW];
+	uint32_t nr_skipping;
+
+	/* Parking lot for waiters that gave up spinning */
+	pthread_mutex_t barrier_lock;
+	pthread_cond_t barrier_cond;
+	int barrier_parked;
+};
+
+static void barrier_wake_parked(void) {
+	struct timer_ctx * tc = sim->timer;
+
+	if (__atomic_load_n(&tc->barrier_parked, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&tc->barrier_lock);
+		pthread_cond_broadcast(&tc->barrier_cond);
+		pthread_mutex_unlock(&tc->barrier_lock);
+	}
+}
+
+/* Count the devices that skipped up to [slot] in again. Return 0 if no
+ * device takes part in [slot] even then */
+static int barrier_rejoin(uint64_t slot) {
+	struct timer_ctx * tc = sim->timer;
+	uint32_t nr = __atomic_exchange_n(&tc->skip_count[slot % SKIP_WINDOW],
+			0, __ATOMIC_RELAXED);
+	uint64_t s;
+
+	if (nr == 0)
+		return BARRIER_NR(__atomic_load_n(&tc->barrier_state,
+					__ATOMIC_RELAXED)) > 0;
+	__atomic_sub_fetch(&tc->nr_skipping, nr, __ATOMIC_SEQ_CST);
+	s = __atomic_add_fetch(&tc->barrier_state,
+			(uint64_t)nr << BARRIER_NR_SHIFT, __ATOMIC_SEQ_CST);
+	return BARRIER_NR(s) > 0;
+}
+
+/* Close the current slot: called by exactly one device, the one that
+ * completed the arrivals */
+static void barrier_release(void) {
+	struct timer_ctx * tc = sim->timer;
+	uint64_t next = tc->time + 1;
+
+	__atomic_and_fetch(&tc->barrier_state, ~BARRIER_ARRIVED_MASK,
+			__ATOMIC_RELAXED);
+	if (tc->fast_forward) {
+		/* All arrivals are in, the wake times are final. A skipping
+		 * device computes in every slot it skips, so none of them is
+		 * jumped over */
+		uint64_t wake = __atomic_exchange_n(&tc->barrier_wake,
+				TIMER_NEVER, __ATOMIC_RELAXED);
+		if (__atomic_load_n(&tc->nr_skipping, __ATOMIC_SEQ_CST) == 0 &&
+				wake != TIMER_NEVER && wake > next)
+			next = wake;
+	}
+
+	/* While every device is skipping, the slots pass without them */
+	while (!barrier_rejoin(next)) {
+		sim_printf("Time slot %3lu\n", next);
+		next++;
 	}
-	pthread_exit(args);
+
+	/* Increase the time slot, which lets devices continue their job */
+	sim_printf("Time slot %3lu\n", next);
+	__atomic_store_n(&tc->time, next, __ATOMIC_SEQ_CST);
+	barrier_wake_parked();
+}
+
+static int pdes_slot_complete(uint64_t t) {
+	struct timer_ctx * tc = sim->timer;
+	uint64_t e = __atomic_load_n(&tc->pending[t % PDES_WINDOW],
+			__ATOMIC_SEQ_CST);
+	uint32_t nr = BARRIER_NR(__atomic_load_n(&tc->barrier_state,
+				__ATOMIC_SEQ_CST));
+	return nr > 0 && PDES_TAG(e) == (uint32_t)t && PDES_COUNT(e) == nr;
+}
+
+/* Close every slot that all devices arrived at. The lock keeps the
+ * "Time slot" lines in order when several devices race to close */
+static void pdes_release(void) {
+	struct timer_ctx * tc = sim->timer;
+	int released = 0;
+
+	if (!pdes_slot_complete(current_time()))
+		return;
+	pthread_mutex_lock(&tc->pdes_release_lock);
+	while (pdes_slot_complete(current_time())) {
+		__atomic_store_n(&tc->time, tc->time + 1, __ATOMIC_SEQ_CST);
+		sim_printf("Time slot %3lu\n", current_time());
+		released = 1;
+	}
+	pthread_mutex_unlock(&tc->pdes_release_lock);
+	if (released)
+		barrier_wake_parked();
+}
+
+/* Wait until the clock reaches slot [t] */
+static void clock_wait(uint64_t t) {
+	struct timer_ctx * tc = sim->timer;
+	int i, spin;
+
+	spin = __atomic_load_n(&tc->barrier_spin, __ATOMIC_RELAXED);
+	for (i = 0; i < spin; i++)
+		if (current_time() >= t)
+			return;
+	pthread_mutex_lock(&tc->barrier_lock);
+	__atomic_add_fetch(&tc->barrier_parked, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&tc->time, __ATOMIC_SEQ_CST) < t)
+		pthread_cond_wait(&tc->barrier_cond, &tc->barrier_lock);
+	__atomic_sub_fetch(&tc->barrier_parked, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&tc->barrier_lock);
+}
+
+/* Record that [timer_id] is done with its local slot and move its
+ * local clock on */
+static void pdes_arrive(struct timer_id_t * timer_id) {
+	struct timer_ctx * tc = sim->timer;
+	uint64_t slot = timer_id->local;
+	uint64_t * e = &tc->pending[slot % PDES_WINDOW];
+	uint64_t old, new;
+
+	/* The entry of [slot] must not still be in use for an older one */
+	if (slot >= current_time() + PDES_WINDOW)
+		clock_wait(slot - PDES_WINDOW + 1);
+
+	old = __atomic_load_n(e, __ATOMIC_RELAXED);
+	do {
+		if (PDES_TAG(old) == (uint32_t)slot)
+			new = old + 1;
+		else
+			new = ((uint64_t)(uint32_t)slot << 32) | 1;
+	} while (!__atomic_compare_exchange_n(e, &old, new, 0,
+			__ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+	timer_id->local = slot + 1;
+	pdes_release();
+}
+
+void timer_sync(struct timer_id_t * timer_id) {
+	if (sim->timer->pdes)
+		clock_wait(timer_id->local);
+}
+
+void timer_advance(struct timer_id_t * timer_id) {
+	if (sim->timer->pdes)
+		pdes_arrive(timer_id);
+	else
+		next_slot(timer_id);
 }
 
 void next_slot(struct timer_id_t * timer_id) {
+	next_slot_until(timer_id, 0);
+}
+
+void next_slot_until(struct timer_id_t * timer_id, uint64_t wake) {
+	struct timer_ctx * tc = sim->timer;
+	uint64_t now = __atomic_load_n(&tc->time, __ATOMIC_ACQUIRE);
+	uint64_t s;
+	int i, spin;
+
+	if (tc->pdes) {
+		pdes_arrive(timer_id);
+		clock_wait(timer_id->local);
+		return;
+	}
+
+	if (tc->fast_forward) {
+		uint64_t old = __atomic_load_n(&tc->barrier_wake,
+				__ATOMIC_RELAXED);
+		while (wake < old && !__atomic_compare_exchange_n(
+				&tc->barrier_wake, &old, wake, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			;
+	}
+
 	/* Tell to timer that we have done our job in current slot */
-	pthread_mutex_lock(&timer_id->event_lock);
-	timer_id->done = 1;
-	pthread_cond_signal(&timer_id->event_cond);
-	pthread_mutex_unlock(&timer_id->event_lock);
+	s = __atomic_add_fetch(&tc->barrier_state, 1, __ATOMIC_ACQ_REL);
+	if (BARRIER_ARRIVED(s) == BARRIER_NR(s)) {
+		barrier_release();
+		return;
+	}
 
 	/* Wait for going to next slot */
-	pthread_mutex_lock(&timer_id->timer_lock);
-	while (timer_id->done) {
-		pthread_cond_wait(
-			&timer_id->timer_cond,
-			&timer_id->timer_lock
-		);
-	}
-	pthread_mutex_unlock(&timer_id->timer_lock);
+	spin = __atomic_load_n(&tc->barrier_spin, __ATOMIC_RELAXED);
+	for (i = 0; i < spin; i++)
+		if (__atomic_load_n(&tc->time, __ATOMIC_ACQUIRE) != now)
+			return;
+	pthread_mutex_lock(&tc->barrier_lock);
+	__atomic_add_fetch(&tc->barrier_parked, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&tc->time, __ATOMIC_SEQ_CST) == now)
+		pthread_cond_wait(&tc->barrier_cond, &tc->barrier_lock);
+	__atomic_sub_fetch(&tc->barrier_parked, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&tc->barrier_lock);
 }
 
 uint64_t current_time() {
-	return _time;
+	return __atomic_load_n(&sim->timer->time, __ATOMIC_RELAXED);
+}
+
+void timer_fast_forward(int enable) {
+	sim->timer->fast_forward = enable;
+}
+
+void timer_jump(uint64_t slot) {
+	__atomic_store_n(&sim->timer->time, slot, __ATOMIC_RELAXED);
+	sim_printf("Time slot %3lu\n", current_time());
+}
+
+void timer_pdes(int enable) {
+	sim->timer->pdes = enable;
+}
+
+static void barrier_update_spin(void) {
+	struct timer_ctx * tc = sim->timer;
+	uint32_t nr = BARRIER_NR(__atomic_load_n(&tc->barrier_state,
+				__ATOMIC_RELAXED));
+	__atomic_store_n(&tc->barrier_spin,
+		nr <= sysconf(_SC_NPROCESSORS_ONLN) ? BARRIER_SPIN : 0,
+		__ATOMIC_RELAXED);
+}
+
+void init_timer() {
+	struct timer_ctx * tc = calloc(1, sizeof(struct timer_ctx));
+
+	tc->barrier_wake = TIMER_NEVER;
+	pthread_mutex_init(&tc->pdes_release_lock, NULL);
+	pthread_mutex_init(&tc->barrier_lock, NULL);
+	pthread_cond_init(&tc->barrier_cond, NULL);
+	sim->timer = tc;
 }
 
 void start_timer() {
-	timer_started = 1;
-	pthread_create(&_timer, NULL, timer_routine, NULL);
+	barrier_update_spin();
+	sim_printf("Time slot %3lu\n", current_time());
+}
+
+/* Take [event] out of the devices the clock waits for */
+static void timer_leave(struct timer_id_t * event) {
+	struct timer_ctx * tc = sim->timer;
+	uint64_t s;
+
+	if (tc->pdes) {
+		/* Leave at the local time, once the others caught up */
+		clock_wait(event->local);
+		__atomic_sub_fetch(&tc->barrier_state, 1ULL << BARRIER_NR_SHIFT,
+				__ATOMIC_SEQ_CST);
+		pdes_release();
+		return;
+	}
+
+	/* The slot may have been waiting for this device only. With none
+	 * left, it still closes for the skipping ones */
+	s = __atomic_sub_fetch(&tc->barrier_state, 1ULL << BARRIER_NR_SHIFT,
+			__ATOMIC_SEQ_CST);
+	if (BARRIER_ARRIVED(s) == BARRIER_NR(s) && (BARRIER_NR(s) > 0 ||
+			__atomic_load_n(&tc->nr_skipping, __ATOMIC_SEQ_CST) > 0))
+		barrier_release();
+}
+
+void timer_unpark(struct timer_id_t * event) {
+	event->local = current_time();
+	__atomic_add_fetch(&sim->timer->barrier_state,
+			1ULL << BARRIER_NR_SHIFT, __ATOMIC_SEQ_CST);
+	barrier_update_spin();
 }
 
 void detach_event(struct timer_id_t * event) {
-	pthread_mutex_lock(&event->event_lock);
+	if (event->fsh)
+		return;
 	event->fsh = 1;
-	pthread_cond_signal(&event->event_cond);
-	pthread_mutex_unlock(&event->event_lock);
+	timer_leave(event);
+}
+
+void timer_skip(struct timer_id_t * timer_id, uint64_t n) {
+	struct timer_ctx * tc = sim->timer;
+	uint64_t back = current_time() + n;
+
+	if (tc->pdes || n <= 1) {
+		/* Local clocks already run ahead */
+		for (; n > 1; n--)
+			pdes_arrive(timer_id);
+		next_slot(timer_id);
+		return;
+	}
+
+	/* Announce the way back before leaving, so that the slot the
+	 * leave closes already knows about it */
+	__atomic_add_fetch(&tc->skip_count[back % SKIP_WINDOW], 1,
+			__ATOMIC_RELAXED);
+	__atomic_add_fetch(&tc->nr_skipping, 1, __ATOMIC_SEQ_CST);
+	timer_leave(timer_id);
+	clock_wait(back);
+}
+
+void timer_park(struct timer_id_t * event) {
+	timer_leave(event);
+	barrier_update_spin();
 }
 
 struct timer_id_t * attach_event() {
-	if (timer_started) {
-		return NULL;
+	struct timer_ctx * tc = sim->timer;
+	struct timer_id_container_t * container =
+		(struct timer_id_container_t*)malloc(
+			sizeof(struct timer_id_container_t)
+		);
+	container->id.fsh = 0;
+	if (tc->dev_list == NULL) {
+		tc->dev_list = container;
+		tc->dev_list->next = NULL;
 	}else{
-		struct timer_id_container_t * container =
-			(struct timer_id_container_t*)malloc(
-				sizeof(struct timer_id_container_t)		
-			);
-		container->id.done = 0;
-		container->id.fsh = 0;
-		pthread_cond_init(&container->id.event_cond, NULL);
-		pthread_mutex_init(&container->id.event_lock, NULL);
-		pthread_cond_init(&container->id.timer_cond, NULL);
-		pthread_mutex_init(&container->id.timer_lock, NULL);
-		if (dev_list == NULL) {
-			dev_list = container;
-			dev_list->next = NULL;
-		}else{
-			container->next = dev_list;
-			dev_list = container;
-		}
-		return &(container->id);
+		container->next = tc->dev_list;
+		tc->dev_list = container;
 	}
+
+	/* The caller holds the current slot open, the new device takes
+	 * part in it */
+	timer_unpark(&container->id);
+	return &(container->id);
 }
 
 void stop_timer() {
-	timer_stop = 1;
-	pthread_join(_timer, NULL);
-	while (dev_list != NULL) {
-		struct timer_id_container_t * temp = dev_list;
-		dev_list = dev_list->next;
-		pthread_cond_destroy(&temp->id.event_cond);
-		pthread_mutex_destroy(&temp->id.event_lock);
-		pthread_cond_destroy(&temp->id.timer_cond);
-		pthread_mutex_destroy(&temp->id.timer_lock);
+	struct timer_ctx * tc = sim->timer;
+
+	while (tc->dev_list != NULL) {
+		struct timer_id_container_t * temp = tc->dev_list;
+		tc->dev_list = tc->dev_list->next;
 		free(temp);
 	}
+	pthread_mutex_destroy(&tc->pdes_release_lock);
+	pthread_mutex_destroy(&tc->barrier_lock);
+	pthread_cond_destroy(&tc->barrier_cond);
+	free(tc);
+	sim->timer = NULL;
 }
 
-
-
-